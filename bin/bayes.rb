@@ -17,17 +17,17 @@ case ARGV[0]
 when "add"
 	case ARGV[1].downcase
 	when "interesting"
-		m.system.train_interesting File.open(ARGV[2]).read
+		File.open(ARGV[2]) { |f| m.system.train_interesting f }
 		puts "#{ARGV[2]} has been classified as interesting"
 	when "uninteresting"
-		m.system.train_uninteresting File.open(ARGV[2]).read
+		File.open(ARGV[2]) { |f| m.system.train_uninteresting f }
 		puts "#{ARGV[2]} has been classified as uninteresting"
 	else
 		puts "Invalid category: choose between interesting and uninteresting"
 		exit(1)
 	end
 when "classify"
-	puts m.system.classify(File.open(ARGV[1]).read)
+	puts File.open(ARGV[1]) { |f| m.system.classify f }
 else
 	puts "Invalid option: choose add [category] [file] or clasify [file]"
 	exit(-1)
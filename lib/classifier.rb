@@ -26,5 +26,10 @@
 
 require 'rubygems'
 require 'classifier/extensions/string'
+require 'classifier/packed'
+require 'classifier/vocabulary'
+require 'classifier/corpus'
 require 'classifier/bayes'
 require 'classifier/lsi'
+require 'classifier/cascade'
+require 'classifier/handle'
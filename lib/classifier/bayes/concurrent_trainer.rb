@@ -0,0 +1,96 @@
+# License::   LGPL
+
+module Classifier
+  class Bayes
+    # A ConcurrentTrainer lets many threads train one Bayes classifier at
+    # once, which the classifier itself cannot do safely:
+    #
+    #   trainer = Classifier::Bayes::ConcurrentTrainer.new b, :tokens => 50_000
+    #   threads = queues.collect do |queue|
+    #     Thread.new { while (m = queue.pop) do trainer.train m.category, m.text end }
+    #   end
+    #   ...
+    #   trainer.flush
+    #
+    # Every thread trains into a shard of its own, a TrainingBuffer, so
+    # tokenizing and counting need no shared lock. Shards are merged into
+    # the classifier under a single lock, when they fill up (see the options
+    # of TrainingBuffer) or on #flush, which merges them all; the counts and
+    # totals of the classifier are therefore only ever changed together.
+    #
+    # Each shard also has a lock of its own, which its thread holds while
+    # training, so that #flush can merge shards from any thread. It is
+    # almost never contended. The shards share the classifier's Vocabulary,
+    # which locks itself for as long as it can grow (see Vocabulary#add).
+    #
+    # To read the classifier while it is being trained, go through
+    # #classify, #classifications or #synchronize.
+    class ConcurrentTrainer
+      Shard = Struct.new(:lock, :buffer)
+
+      attr_reader :bayes
+
+      def initialize(bayes, options = {})
+        @bayes = bayes
+        @lock = Mutex.new
+        @options = options.merge(:lock => @lock)
+        @shards, @shards_lock = Hash.new, Mutex.new
+      end
+
+      # Trains +text+ in +category+ from the calling thread's shard, as
+      # Bayes#train.
+      def train(category, text, options = {})
+        shard = shard_for(Thread.current)
+        shard.lock.synchronize { shard.buffer.train(category, text, options) }
+        self
+      end
+
+      # Trains pre-tokenized counts, as Bayes#train_counts.
+      def train_counts(category, counts, options = {})
+        shard = shard_for(Thread.current)
+        shard.lock.synchronize { shard.buffer.train_counts(category, counts, options) }
+        self
+      end
+
+      # Returns the number of counts waiting in all the shards.
+      def pending
+        shards.inject(0) { |sum, shard| sum + shard.buffer.pending }
+      end
+
+      # Merges every shard into the classifier, and drops the shards of
+      # threads that have finished.
+      def flush
+        @shards_lock.synchronize { @shards.to_a }.each do |thread, shard|
+          shard.lock.synchronize { shard.buffer.flush }
+          @shards_lock.synchronize { @shards.delete(thread) } unless thread.alive?
+        end
+        self
+      end
+
+      # Runs the block with training into the classifier held off.
+      def synchronize(&block)
+        @lock.synchronize(&block)
+      end
+
+      def classify(text)
+        synchronize { @bayes.classify(text) }
+      end
+
+      def classifications(text)
+        synchronize { @bayes.classifications(text) }
+      end
+
+      private
+
+      def shards
+        @shards_lock.synchronize { @shards.values }
+      end
+
+      def shard_for(thread)
+        @shards_lock.synchronize do
+          @shards[thread] ||= Shard.new(Mutex.new, TrainingBuffer.new(@bayes, @options))
+        end
+      end
+    end
+  end
+end
@@ -0,0 +1,273 @@
+# License::   LGPL
+
+module Classifier
+  class Bayes
+    # A DiskStore keeps a classifier's word counts in a file instead of in
+    # memory, for models whose long tail of rare tokens no longer fits in RAM
+    # alongside everything else:
+    #
+    #   store = Classifier::Bayes::DiskStore.new "spam.counts"
+    #   b     = Classifier::Bayes.new 'Spam', 'Ham', :store => store
+    #
+    # The file is an open addressing hash table of fixed size records, one
+    # per category and token, which lookups probe with pread. Recently used
+    # counts stay in an in-memory cache of up to :cache entries, and writes
+    # from training are held back and written :batch at a time. Call #flush,
+    # or #close, before the process exits; marshaling the classifier flushes
+    # too, and dumps only the path of its store.
+    #
+    # After the table the file also keeps the category names, with the
+    # number of documents and the total count of each, which Bayes keeps up
+    # to date in #documents and #totals, so that a classifier given an
+    # existing store scores as it did before.
+    #
+    # Records hold token ids, not tokens: the vocabulary that maps one to
+    # the other is not kept in the file. Give the classifier the same
+    # vocabulary again when reopening a store, through :vocabulary, or its
+    # counts belong to whatever tokens happen to get those ids.
+    class DiskStore
+      MAGIC  = "CLBAYES1"
+      HEADER = 4096 # magic, table size, records used, size of the categories
+      RECORD = 16   # category index, token id, count
+      EMPTY  = 0xFFFFFFFF
+      PROBE  = 16   # records read by a single pread
+
+      attr_reader :path, :documents, :totals
+
+      # Opens the store at +path+, creating it if needed. Options are
+      # :cache, the number of counts to keep in memory (100_000 by default),
+      # and :batch, the number of pending writes to hold (10_000).
+      def initialize(path, options = {})
+        @path, @options = path, options
+        @cache_size = options[:cache] || 100_000
+        @batch_size = options[:batch] || 10_000
+        @cache, @dirty = Hash.new, Hash.new
+        @documents, @totals = Hash.new(0), Hash.new(0)
+        File.exist?(path) && File.size(path) > 0 ? open_file : create_file(16)
+      end
+
+      # Returns the Hash-like table of counts for +category+, which Bayes
+      # uses in place of its own in-memory Hash.
+      def table(category)
+        name = category.to_s
+        unless @names.include?(name)
+          @names << name
+          write_header
+        end
+        Table.new(self, @names.index(name))
+      end
+
+      # Returns the count of token +id+ in category number +category+, or 0.
+      def fetch(category, id)
+        key = (category << 32) | id
+        count = @cache.delete(key) || @dirty[key] || read(key)
+        @cache[key] = count
+        @cache.shift if @cache.size > @cache_size
+        count
+      end
+
+      # Sets the count of token +id+ in category number +category+.
+      def store(category, id, count)
+        key = (category << 32) | id
+        @cache.delete(key)
+        @cache[key] = @dirty[key] = count
+        @cache.shift if @cache.size > @cache_size
+        flush if @dirty.size >= @batch_size
+        count
+      end
+
+      # Yields the id and count of every token in category number +category+.
+      # This reads the whole file, so Bayes only does it to rebuild totals.
+      def each_count(category)
+        flush
+        each_record(@file, @bits) do |cat, id, count|
+          yield id, count if cat == category && count != 0
+        end
+      end
+
+      # Writes out all pending counts.
+      def flush
+        @dirty.each { |key, count| place(key, count) }
+        @dirty.clear
+        write_header
+        self
+      end
+
+      def close
+        flush
+        @file.close
+      end
+
+      def marshal_dump
+        flush
+        [@path, @options]
+      end
+
+      def marshal_load(data)
+        initialize(*data)
+      end
+
+      # The counts of one category, answering the parts of the Hash
+      # interface that Bayes uses. Absent tokens read as nil.
+      class Table
+        include Enumerable
+
+        def initialize(store, category)
+          @store, @category = store, category
+        end
+
+        def [](id)
+          count = @store.fetch(@category, id)
+          count == 0 ? nil : count
+        end
+
+        def []=(id, count)
+          @store.store(@category, id, count)
+        end
+
+        def delete(id)
+          count = self[id]
+          @store.store(@category, id, 0) if count
+          count
+        end
+
+        def has_key?(id)
+          !self[id].nil?
+        end
+
+        def each(&block)
+          @store.each_count(@category, &block)
+        end
+
+        def keys
+          collect { |id, count| id }
+        end
+
+        def values
+          collect { |id, count| count }
+        end
+      end
+
+      private
+
+      def read(key)
+        _, count = locate(@file, @bits, key)
+        count || 0
+      end
+
+      # Writes +count+ to the record of +key+, adding a record (and growing
+      # the table first if it is too full) when the key is new.
+      def place(key, count)
+        slot, old = locate(@file, @bits, key)
+        if old.nil?
+          return if count == 0
+          if (@used + 1) * 10 > (1 << @bits) * 7
+            grow
+            slot, old = locate(@file, @bits, key)
+          end
+          @used += 1
+        end
+        write_record(@file, slot, key, count)
+      end
+
+      # Returns the slot holding +key+ and its count, or the empty slot where
+      # it belongs and nil.
+      def locate(io, bits, key)
+        size = 1 << bits
+        slot = ((key * 0x9E3779B97F4A7C15) & 0xFFFFFFFFFFFFFFFF) >> (64 - bits)
+        loop do
+          run = [PROBE, size - slot].min
+          records = io.pread(run * RECORD, HEADER + slot * RECORD).unpack("L<L<E" * run)
+          records.each_slice(3) do |cat, id, count|
+            return slot, nil if cat == EMPTY
+            return slot, integral(count) if ((cat << 32) | id) == key
+            slot += 1
+          end
+          slot = 0 if slot == size
+        end
+      end
+
+      def write_record(io, slot, key, count)
+        io.pwrite([key >> 32, key & EMPTY, count].pack('L<L<E'), HEADER + slot * RECORD)
+      end
+
+      def each_record(io, bits)
+        size, slot = 1 << bits, 0
+        while slot < size
+          run = [4096, size - slot].min
+          io.pread(run * RECORD, HEADER + slot * RECORD).unpack("L<L<E" * run).each_slice(3) do |cat, id, count|
+            yield cat, id, integral(count) unless cat == EMPTY
+          end
+          slot += run
+        end
+      end
+
+      # Rehashes every record into a table twice the size.
+      def grow
+        grown = "#{@path}.grow"
+        File.open(grown, "wb+") do |io|
+          fill(io, @bits + 1)
+          each_record(@file, @bits) do |cat, id, count|
+            key = (cat << 32) | id
+            slot, _ = locate(io, @bits + 1, key)
+            write_record(io, slot, key, count)
+          end
+        end
+        @file.close
+        File.rename(grown, @path)
+        @file = File.open(@path, "rb+")
+        @bits += 1
+        write_header
+      end
+
+      def create_file(bits)
+        @bits, @used, @names = bits, 0, []
+        @file = File.open(@path, "wb+")
+        fill(@file, bits)
+        write_header
+      end
+
+      def fill(io, bits)
+        io.pwrite("\0" * HEADER, 0)
+        empty = "\xFF".b * (4096 * RECORD)
+        (1 << bits).div(4096).times { |i| io.pwrite(empty, HEADER + i * empty.bytesize) }
+      end
+
+      def open_file
+        @file = File.open(@path, "rb+")
+        header = @file.pread(HEADER, 0)
+        raise ArgumentError, "Not a Bayes store: #{@path}" unless header.start_with?(MAGIC)
+        @bits, @used, length = header[MAGIC.size, 16].unpack('L<Q<L<')
+        read_categories(@file.pread(length, categories_offset))
+      end
+
+      # The categories section: the size of the names, the names separated
+      # by NULs, then each category's documents and total as doubles.
+      def read_categories(section)
+        length = section.unpack1('L<')
+        @names = section.byteslice(4, length).force_encoding(Encoding::UTF_8).split("\0")
+        section.unpack("E#{2 * @names.size}", :offset => 4 + length).each_slice(2).with_index do |(documents, total), i|
+          category = @names[i].intern
+          @documents[category], @totals[category] = integral(documents), integral(total)
+        end
+      end
+
+      def write_header
+        names = @names.join("\0").b
+        totals = @names.collect { |name| [@documents[name.intern], @totals[name.intern]] }.flatten.pack('E*')
+        section = [names.bytesize].pack('L<') + names + totals
+        @file.pwrite(section, categories_offset)
+        @file.pwrite(MAGIC + [@bits, @used, section.bytesize].pack('L<Q<L<'), 0)
+      end
+
+      def categories_offset
+        HEADER + (1 << @bits) * RECORD
+      end
+
+      # Counts are stored as doubles; whole counts come back as Integers.
+      def integral(count)
+        count == count.to_i ? count.to_i : count
+      end
+    end
+  end
+end
@@ -0,0 +1,235 @@
+# License::   LGPL
+
+require 'zlib'
+require 'fileutils'
+
+module Classifier
+  class Bayes
+    # A Journal remembers the tokens each document was trained with, so that
+    # the document can be untrained by its id long after its text is gone:
+    #
+    #   journal = Classifier::Bayes::Journal.new "spam.journal"
+    #   b = Classifier::Bayes.new 'Spam', 'Ham', :journal => journal
+    #   b.train :spam, message, :id => message_id
+    #   ...
+    #   b.untrain_id message_id
+    #
+    # The journal is a directory of append-only segment files. Each record
+    # holds a document id, its category and its (token id, count) pairs,
+    # with the token ids sorted and delta coded as BER integers, so that a
+    # document takes a byte or two per distinct token. Forgetting a document
+    # appends a tombstone. Only the position of each live record is kept in
+    # memory; it is rebuilt by reading the segments when the journal opens.
+    #
+    # Once a segment reaches :segment_bytes (16MB by default), a new one is
+    # started. #compact rewrites the full segments as a single one holding
+    # just the documents that are still trained, and removes the old ones.
+    class Journal
+      MAGIC  = "CLJRNL1"
+      HEADER = 8 # magic, and whether the segment is a compacted base
+      TRAIN, FORGET = 1, 2
+
+      attr_reader :path
+
+      # Opens the journal in the directory +path+, creating it if needed.
+      def initialize(path, options = {})
+        @path, @options = path, options
+        @segment_bytes = options[:segment_bytes] || 16 * 1024 * 1024
+        FileUtils.mkdir_p path
+        open_segments
+      end
+
+      # Returns the number of documents that are trained.
+      def size
+        @index.size
+      end
+
+      def include?(id)
+        @index.has_key?(id)
+      end
+
+      # Records that document +id+ was trained in +category+ with +pairs+,
+      # (token id, count) pairs with Integer counts.
+      def record(id, category, pairs)
+        id = id.to_s
+        raise ArgumentError, "Document #{id} has already been trained" if @index.has_key?(id)
+        ids, previous = [], 0
+        pairs.sort_by { |token, count| token }.each do |token, count|
+          raise ArgumentError, "Journaled counts must be whole numbers" unless count.is_a?(Integer) && count > 0
+          ids << token - previous << count
+          previous = token
+        end
+        @index[id] = append(TRAIN, id, category.to_s, [pairs.size].pack('w') << ids.pack('w*'))
+      end
+
+      # Returns the category and the (token id, count) pairs document +id+
+      # was trained with, or nil if it is not in the journal.
+      def fetch(id)
+        location = @index[id.to_s]
+        return nil unless location
+        _, _, category, pairs = read_record(*location)
+        [category, pairs]
+      end
+
+      # Forgets document +id+, returning whether it was known.
+      def forget(id)
+        id = id.to_s
+        return false unless @index.delete(id)
+        append FORGET, id, "", ""
+        true
+      end
+
+      # Rewrites every segment but the one being written as a single
+      # segment, dropping forgotten documents and their tombstones. A
+      # tombstone always follows its document, so any left in the current
+      # segment refer to documents that are gone either way.
+      def compact
+        sealed = @segments[0...-1]
+        return self if sealed.empty? || (sealed.size == 1 && base?(sealed[0]))
+        target = sealed.last
+        compacted = "#{segment_path(target)}.compact"
+        moved = Hash.new
+        File.open(compacted, "wb") do |io|
+          io.write MAGIC + "\1"
+          @index.each do |id, (segment, offset)|
+            next unless sealed.include?(segment)
+            moved[id] = [target, io.pos]
+            io.write record_bytes(segment, offset)
+          end
+          io.fsync
+        end
+        @files.delete(target).close
+        File.rename(compacted, segment_path(target))
+        @files[target] = File.open(segment_path(target), "rb")
+        @index.update(moved)
+        # The base supersedes every older segment, so a crash before these
+        # are removed only leaves files that are ignored on opening.
+        sealed[0...-1].each { |segment| remove_segment segment }
+        @segments = [target, @segments.last]
+        self
+      end
+
+      def flush
+        @writer.flush
+        self
+      end
+
+      def close
+        @writer.close
+        @files.each_value { |io| io.close unless io.closed? }
+      end
+
+      def marshal_dump
+        flush
+        [@path, @options]
+      end
+
+      def marshal_load(data)
+        initialize(*data)
+      end
+
+      private
+
+      def segment_path(segment)
+        File.join(@path, "segment-%06d" % segment)
+      end
+
+      def base?(segment)
+        @files[segment].size >= HEADER && @files[segment].pread(HEADER, 0) == MAGIC + "\1"
+      end
+
+      # A compaction cut short by a crash leaves its half written segment
+      # behind under a .compact name; the segments it was made from are all
+      # still there, so it is removed.
+      def open_segments
+        Dir.glob(File.join(@path, "segment-*.compact")).each { |stale| File.delete stale }
+        @segments = Dir.children(@path).grep(/\Asegment-\d+\z/).collect { |name| name[8..-1].to_i }.sort
+        @files, @index = Hash.new, Hash.new
+        @segments.each { |segment| @files[segment] = File.open(segment_path(segment), "rb") }
+        base = @segments.reverse.find { |segment| base?(segment) }
+        if base
+          @segments.select { |segment| segment < base }.each { |segment| remove_segment segment }
+          @segments -= @segments.select { |segment| segment < base }
+        end
+        @segments.each { |segment| replay segment }
+        start_segment(@segments.empty? ? 1 : @segments.last)
+      end
+
+      def remove_segment(segment)
+        io = @files.delete(segment)
+        io.close if io
+        File.delete(segment_path(segment)) if File.exist?(segment_path(segment))
+      end
+
+      # Reads the records of a segment into the index. A record cut short
+      # by a crash ends the segment, and is cut off.
+      def replay(segment)
+        io, offset, size = @files[segment], HEADER, @files[segment].size
+        while offset + 8 <= size
+          length, crc = io.pread(8, offset).unpack('L<L<')
+          break if offset + 8 + length > size
+          body = io.pread(length, offset + 8)
+          break unless Zlib.crc32(body) == crc
+          type, id = parse(body, false)
+          type == TRAIN ? @index[id] = [segment, offset] : @index.delete(id)
+          offset += 8 + length
+        end
+        File.truncate(segment_path(segment), offset) if offset < size
+      end
+
+      def start_segment(segment)
+        path = segment_path(segment)
+        # A segment too short for its header was cut off as it was started.
+        fresh = !File.exist?(path) || File.size(path) < HEADER
+        @writer = File.open(path, fresh ? "wb" : "ab")
+        @writer.write(MAGIC + "\0") if fresh
+        @writer.flush
+        @files[segment] ||= File.open(path, "rb")
+        @segments << segment unless @segments.include?(segment)
+      end
+
+      def append(type, id, category, pairs)
+        if @writer.pos >= @segment_bytes
+          @writer.close
+          start_segment(@segments.last + 1)
+        end
+        id, category = id.b, category.b
+        body = [type, id.bytesize].pack('Cw') << id << [category.bytesize].pack('w') << category << pairs.b
+        location = [@segments.last, @writer.pos]
+        @writer.write [body.bytesize, Zlib.crc32(body)].pack('L<L<') << body
+        @writer.flush
+        location
+      end
+
+      def record_bytes(segment, offset)
+        length = @files[segment].pread(4, offset).unpack1('L<')
+        @files[segment].pread(8 + length, offset)
+      end
+
+      def read_record(segment, offset)
+        parse(record_bytes(segment, offset)[8..-1], true)
+      end
+
+      # Splits a record into its type, id, category and, when +pairs+ is
+      # set, its (token id, count) pairs.
+      def parse(body, pairs)
+        type, length = body.unpack('Cw')
+        at = 1 + [length].pack('w').bytesize
+        id = body.byteslice(at, length).force_encoding(Encoding::UTF_8)
+        return type, id unless pairs
+        at += length
+        length = body.unpack1('w', :offset => at)
+        at += [length].pack('w').bytesize
+        category = body.byteslice(at, length).force_encoding(Encoding::UTF_8)
+        at += length
+        count, *numbers = body.byteslice(at, body.bytesize - at).unpack('w*')
+        token, result = 0, []
+        count.times do |i|
+          token += numbers[2 * i]
+          result << [token, numbers[2 * i + 1]]
+        end
+        return type, id, category, result
+      end
+    end
+  end
+end
@@ -0,0 +1,145 @@
+# License::   LGPL
+
+module Classifier
+  class Bayes
+    # A ScoreTable whose weights are quantized to 16 or 8 bit integers, for
+    # serving from a fraction of the memory: see Bayes#compile. Each
+    # category has its own scale and offset, so that its weights span the
+    # whole integer range, and a weight w is stored as
+    #   q = ((w - offset) / scale).round
+    #
+    # Scoring adds up the stored integers, and counts the tokens seen, per
+    # category; the scale and offset are applied once per category at the
+    # end, since the sum of k weights is scale * (sum of q) + k * offset.
+    #
+    # All rows live in a single binary String, each as its length, the
+    # positions of its categories and their quantized weights, and are
+    # found through a packed table of offsets indexed by token id.
+    class QuantizedScoreTable < ScoreTable
+      FORMATS = { 16 => 's<', 8 => 'c' }
+      NO_ROW = 0xFFFFFFFF
+
+      attr_reader :bits
+
+      def initialize(vocabulary, categories, baseline, prior, postings, bits = 16)
+        raise ArgumentError, "Weights can be quantized to 16 or 8 bits, not #{bits}" unless FORMATS[bits]
+        @vocabulary, @categories = vocabulary, categories
+        @baseline, @prior, @bits = baseline, prior, bits
+        @format = FORMATS[bits]
+        @position_format, @position_size = categories.size < 2**16 ? ['S<', 2] : ['L<', 4]
+        compute_scales postings
+        pack_rows postings
+        freeze
+      end
+
+      # The largest error in any single weight, which is half a step.
+      def max_weight_error
+        @scale.max / 2.0
+      end
+
+      # Compares this table with the float model it was compiled from (a
+      # Bayes classifier or ScoreTable) on +texts+, returning the largest and
+      # the mean absolute error in the scores, and the share of texts for
+      # which both pick the same best category.
+      def deviation(reference, texts)
+        max, sum, compared, agree = 0.0, 0.0, 0, 0
+        texts.each do |text|
+          exact, approx = reference.classifications(text), classifications(text)
+          approx.each do |category, score|
+            next unless score.finite? && exact[category].finite?
+            error = (score - exact[category]).abs
+            max = error if error > max
+            sum += error
+            compared += 1
+          end
+          agree += 1 if exact.max_by { |c, s| s }.first == approx.max_by { |c, s| s }.first
+        end
+        { :max_error => max, :mean_error => compared > 0 ? sum / compared : 0.0,
+          :agreement => texts.empty? ? 1.0 : agree.to_f / texts.size }
+      end
+
+      # Returns the bytes of packed rows and offsets.
+      def bytesize
+        @rows.bytesize + @offsets.bytesize
+      end
+
+      private
+
+      def compute_scales(postings)
+        size = @categories.size
+        low, high = Array.new(size, Float::INFINITY), Array.new(size, -Float::INFINITY)
+        postings.each_value do |weights|
+          weights.each do |c, weight|
+            low[c] = weight if weight < low[c]
+            high[c] = weight if weight > high[c]
+          end
+        end
+        # The range is kept symmetric, -limit..limit, so that rounding can
+        # never step outside it.
+        limit = 2**(@bits - 1) - 1
+        @offset, @scale = Array.new(size, 0.0), Array.new(size, 0.0)
+        size.times do |c|
+          next unless low[c].finite?
+          @offset[c] = (low[c] + high[c]) / 2.0
+          @scale[c] = (high[c] - low[c]) / (2 * limit)
+        end
+      end
+
+      def pack_rows(postings)
+        rows, size = [], 0
+        offsets = Array.new(@vocabulary.size, NO_ROW)
+        postings.each do |id, weights|
+          next if id >= offsets.size
+          positions = weights.keys
+          row = [positions.size].pack('L<') << positions.pack("#{@position_format}*")
+          row << positions.collect { |c| quantize(weights[c], c) }.pack("#{@format}*")
+          offsets[id] = size
+          size += row.bytesize
+          rows << row
+        end
+        # Joined once, so that the String is no bigger than its contents.
+        @rows, @offsets, @table_size = rows.join.force_encoding(Encoding::BINARY), offsets.pack('L<*'), offsets.size
+      end
+
+      # A category whose weights are all the same has a scale of 0, and
+      # stores only zeros.
+      def quantize(weight, c)
+        @scale[c] > 0 ? ((weight - @offset[c]) / @scale[c]).round : 0
+      end
+
+      def weights_for(id)
+        return [] unless id < @table_size
+        offset = @offsets.unpack1('L<', :offset => 4 * id)
+        return [] if offset == NO_ROW
+        n = @rows.unpack1('L<', :offset => offset)
+        positions = @rows.unpack("#{@position_format}#{n}", :offset => offset + 4)
+        values = @rows.unpack("#{@format}#{n}", :offset => offset + 4 + n * @position_size)
+        positions.each_with_index.collect { |c, i| [c, values[i] * @scale[c] + @offset[c]] }
+      end
+
+      def scores_for(text)
+        seen = Hash.new
+        text.each_word { |word| seen[word] = true }
+        ids = seen.keys.collect { |word| @vocabulary[word] }
+        size = @categories.size
+        sums, hits = Array.new(size, 0), Array.new(size, 0)
+        ids.each do |id|
+          next unless id && id < @table_size
+          offset = @offsets.unpack1('L<', :offset => 4 * id)
+          next if offset == NO_ROW
+          n = @rows.unpack1('L<', :offset => offset)
+          positions = @rows.unpack("#{@position_format}#{n}", :offset => offset + 4)
+          values = @rows.unpack("#{@format}#{n}", :offset => offset + 4 + n * @position_size)
+          positions.each_with_index do |c, i|
+            sums[c] += values[i]
+            hits[c] += 1
+          end
+        end
+        n = ids.size
+        Array.new(size) do |c|
+          (n == 0 ? 0 : n * @baseline[c]) + @prior[c] + sums[c] * @scale[c] + hits[c] * @offset[c]
+        end
+      end
+    end
+  end
+end
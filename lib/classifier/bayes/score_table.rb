@@ -0,0 +1,114 @@
+# License::   LGPL
+
+module Classifier
+  class Bayes
+    # A ScoreTable is a compiled, read-only copy of a Bayes classifier for
+    # serving: see Bayes#compile. Every category has a position, and every
+    # token a row holding, for each category that has seen it, the log
+    # weight log(count / 0.1) that Bayes#classifications adds for it. Scoring
+    # a text is then the sum of the baseline and the rows of its tokens, with
+    # no logarithms or Hash lookups per category.
+    #
+    # Rows of tokens seen by a good share of the categories are stored whole.
+    # With GSL installed they are GSL::Vectors, so adding one is a single
+    # native vector operation; the other rows are sparse, and are added an
+    # entry at a time.
+    #
+    # The table does not follow later training; compile it again instead.
+    class ScoreTable
+      # Rows with entries for at least this share of the categories are
+      # stored whole.
+      DENSE_SHARE = 0.125
+
+      attr_reader :categories
+
+      # categories is the Array of category names, baseline and prior the
+      # per-token baseline weight and the prior of each, and postings a Hash
+      # of token id => { category position => log weight }.
+      def initialize(vocabulary, categories, baseline, prior, postings)
+        @vocabulary, @categories = vocabulary, categories
+        @baseline, @prior = baseline, prior
+        @dense, @sparse = {}, {}
+        size = categories.size
+        postings.each do |id, weights|
+          if $GSL && weights.size >= size * DENSE_SHARE
+            row = GSL::Vector.alloc(size)
+            weights.each { |c, weight| row[c] = weight }
+            @dense[id] = row
+          else
+            @sparse[id] = [weights.keys, weights.values]
+          end
+        end
+        freeze
+      end
+
+      # Returns the same Hash of category => score as Bayes#classifications
+      # (up to rounding, when dense rows are summed on their own).
+      def classifications(text)
+        scores = scores_for(text)
+        result = Hash.new
+        @categories.each_with_index { |category, c| result[category] = scores[c] }
+        result
+      end
+
+      # Returns the best category for text, as Bayes#classify does.
+      def classify(text)
+        top(text, 1).first
+      end
+
+      # Returns the count best categories for text, best first.
+      def top(text, count)
+        scores = scores_for(text)
+        best = []
+        scores.each_with_index do |score, c|
+          next if best.size >= count && score <= scores[best.last]
+          at = best.index { |b| score > scores[b] } || best.size
+          best.insert(at, c)
+          best.pop if best.size > count
+        end
+        best.collect { |c| @categories[c] }
+      end
+
+      # Returns a Session scoring with this table; see Bayes#session.
+      def session(options = {})
+        Session.new(@vocabulary, @categories, @baseline, @prior, method(:weights_for), options)
+      end
+
+      private
+
+      # Returns the (category position, weight) pairs of token +id+.
+      def weights_for(id)
+        if (row = @dense[id])
+          row.to_a.each_with_index.collect { |weight, c| [c, weight] }
+        elsif (row = @sparse[id])
+          row[0].zip(row[1])
+        else
+          []
+        end
+      end
+
+      # Returns the score of every category, by position.
+      def scores_for(text)
+        seen = Hash.new
+        text.each_word { |word| seen[word] = true }
+        ids = seen.keys.collect { |word| @vocabulary[word] }
+        n = ids.size
+        scores = Array.new(@categories.size) { |c| (n == 0 ? 0 : n * @baseline[c]) + @prior[c] }
+        dense = nil
+        ids.each do |id|
+          next unless id
+          if (row = @dense[id])
+            dense = dense ? dense + row : row
+          elsif (row = @sparse[id])
+            positions, weights = row
+            positions.each_with_index { |c, i| scores[c] += weights[i] }
+          end
+        end
+        return scores unless dense
+        dense = dense.to_a
+        scores.each_index { |c| scores[c] += dense[c] }
+        scores
+      end
+    end
+  end
+end
@@ -0,0 +1,133 @@
+# License::   LGPL
+
+module Classifier
+  class Bayes
+    # A Session classifies a text that arrives a chunk at a time, such as a
+    # message still being received, and can decide before it is complete:
+    #
+    #   session = b.session :margin => 5.0
+    #   while (chunk = socket.read(4096))
+    #     session << chunk
+    #     break if session.decided?
+    #   end
+    #   session.finish
+    #   session.classify
+    #
+    # Sessions come from Bayes#session and ScoreTable#session. The running
+    # score of each category is kept as it is in Bayes#classifications: the
+    # number of distinct tokens times the category's baseline, plus its
+    # prior, plus the weights of the tokens it has seen. Each new token adds
+    # only to the categories that have seen it, so feeding a chunk costs its
+    # tokens, plus one pass over the categories to look for a decision.
+    #
+    # Chunks are cut after their last whitespace, and the rest is held until
+    # the next chunk or #finish, so tokens split between chunks come out
+    # whole (see Classifier::WordStream for runs with no whitespace at
+    # all). Once the best category leads the next by :margin (a log odds
+    # ratio, 5.0 by default), that category is the decision, and text fed
+    # afterwards is ignored. The limits of Classifier::TokenLimits apply to
+    # the session as a whole, except sampling.
+    class Session
+      attr_reader :margin, :bytes, :decision
+
+      # categories is the Array of category names, baseline and prior their
+      # per-token baseline and prior, and weights is called with a token id
+      # and returns (category position, weight) pairs for it.
+      def initialize(vocabulary, categories, baseline, prior, weights, options = {})
+        @vocabulary, @categories = vocabulary, categories
+        @baseline, @prior, @weights = baseline, prior, weights
+        @margin = options[:margin] || 5.0
+        @sums = Array.new(categories.size, 0.0)
+        @seen = Hash.new
+        @carry = "".b
+        @bytes = 0
+        @decision = nil
+      end
+
+      # Feeds the next chunk of text, returning the decision, or nil if there
+      # is none yet.
+      def feed(chunk)
+        return @decision if @decision
+        limit = TokenLimits.max_bytes
+        chunk = chunk.byteslice(0, [limit - @bytes, 0].max) if limit && @bytes + chunk.bytesize > limit
+        @bytes += chunk.bytesize
+        @encoding ||= chunk.encoding
+        ready, @carry = WordStream.cut(@carry, chunk.b)
+        tokenize ready if ready
+        decide
+      end
+
+      def <<(chunk)
+        feed chunk
+        self
+      end
+
+      # Tokenizes what is left of the text, and returns the decision if
+      # there is one.
+      def finish
+        unless @decision || @carry.nil? || @carry.empty?
+          tokenize @carry
+          @carry = "".b
+          decide
+        end
+        @decision
+      end
+
+      def decided?
+        !@decision.nil?
+      end
+
+      # Returns the scores so far, as Bayes#classifications would for the
+      # text fed so far (up to the held back rest of the last chunk).
+      def classifications
+        scores = scores_now
+        result = Hash.new
+        @categories.each_with_index { |category, c| result[category] = scores[c] }
+        result
+      end
+
+      # Returns the decision, or failing that the best category so far.
+      def classify
+        return @decision if @decision
+        scores = scores_now
+        @categories[scores.each_index.max_by { |c| scores[c] }]
+      end
+
+      private
+
+      def tokenize(text)
+        text.force_encoding(@encoding || Encoding.default_external)
+        text = text.scrub("") unless text.valid_encoding?
+        text.scan_clean_words { |word| add word }
+        text.scan_symbols { |symbol| add symbol }
+      end
+
+      def add(token)
+        return if @seen[token]
+        return if TokenLimits.max_tokens && @seen.size >= TokenLimits.max_tokens
+        @seen[token] = true
+        id = @vocabulary[token]
+        @weights.call(id).each { |c, weight| @sums[c] += weight } if id
+      end
+
+      def scores_now
+        n = @seen.size
+        Array.new(@categories.size) { |c| (n == 0 ? 0 : n * @baseline[c]) + @prior[c] + @sums[c] }
+      end
+
+      def decide
+        return @decision if @decision || @categories.size < 2 || @seen.empty?
+        best = second = -Float::INFINITY
+        position = nil
+        scores_now.each_with_index do |score, c|
+          if score > best
+            best, second, position = score, best, c
+          elsif score > second
+            second = score
+          end
+        end
+        @decision = @categories[position] if position && best - second >= @margin
+      end
+    end
+  end
+end
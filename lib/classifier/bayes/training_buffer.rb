@@ -0,0 +1,116 @@
+# License::   LGPL
+
+module Classifier
+  class Bayes
+    # A TrainingBuffer collects the token counts of many trainings and adds
+    # them to a Bayes classifier in one go, for bursts of training:
+    #
+    #   buffer = Classifier::Bayes::TrainingBuffer.new b, :tokens => 50_000
+    #   messages.each { |category, text| buffer.train category, text }
+    #   buffer.flush
+    #
+    # Counts are summed per category and token in a small Hash of their own,
+    # so that a token trained in a thousand documents costs the classifier
+    # one update instead of a thousand, and its totals are updated once per
+    # category. Each flush adds the tokens in id order.
+    #
+    # The buffer flushes by itself once it holds :tokens distinct counts
+    # (100_000 by default), or when it is trained more than :seconds after
+    # its oldest pending training (not at all by default). Until then, the
+    # classifier does not see the buffered training. Documents trained with
+    # an :id go straight to the classifier, since they are journaled one by
+    # one; they bypass the buffer, so the classifier sees them before any
+    # documents buffered earlier. Call #flush first where that matters.
+    #
+    # A buffer is meant for a single thread. Given a Mutex as :lock, it
+    # holds that lock whenever it writes to the classifier, so that buffers
+    # in several threads can share one (see ConcurrentTrainer).
+    class TrainingBuffer
+      attr_reader :bayes
+
+      def initialize(bayes, options = {})
+        @bayes = bayes
+        @max_tokens = options[:tokens] || 100_000
+        @max_seconds = options[:seconds]
+        @lock = options[:lock]
+        @counts = Hash.new { |counts, category| counts[category] = Hash.new(0) }
+        @documents = Hash.new(0)
+        @pending, @since = 0, nil
+      end
+
+      # Buffers the training of +text+ in +category+, as Bayes#train.
+      def train(category, text, options = {})
+        return locked { @bayes.train(category, text, options) } if options[:id]
+        vocabulary = @bayes.vocabulary
+        add(category) do |counts|
+          text.each_word { |word| id = vocabulary.add(word); counts[id] += 1 if id }
+        end
+      end
+
+      # Buffers pre-tokenized counts, as Bayes#train_counts.
+      def train_counts(category, counts, options = {})
+        return locked { @bayes.train_counts(category, counts, options) } if options[:id]
+        vocabulary = @bayes.vocabulary
+        add(category) do |buffered|
+          counts.each do |term, count|
+            id = vocabulary.id_for(term)
+            buffered[id] += count if id
+          end
+        end
+      end
+
+      # Returns the number of buffered (category, token) counts.
+      def pending
+        @pending
+      end
+
+      # Adds everything buffered to the classifier, category by category.
+      # Each category is merged whole or not at all (see Bayes#merge_ids),
+      # and leaves the buffer as soon as it is merged, so that if a merge
+      # fails, flushing again adds exactly what is left.
+      def flush
+        merges = @counts.collect do |category, counts|
+          [category, counts.keys.sort!.collect! { |id| [id, counts[id]] }]
+        end
+        locked do
+          merges.each do |category, sorted|
+            @bayes.merge_ids category, sorted, @documents[category]
+            @pending -= @counts.delete(category).size
+            @documents.delete(category)
+          end
+        end
+        @pending, @since = 0, nil
+        self
+      end
+
+      private
+
+      # Yields the buffered counts of +category+ to be added to, tokens
+      # going straight into them rather than through a Hash per document.
+      # Unknown categories are refused here, as Bayes#train would, rather
+      # than when the buffer is flushed.
+      def add(category)
+        category = category.prepare_category_name
+        unless @counts.has_key?(category) || @bayes.categories.include?(category.to_s)
+          raise StandardError, "No such category: #{category}"
+        end
+        counts = @counts[category]
+        size = counts.size
+        yield counts
+        @pending += counts.size - size
+        @documents[category] += 1
+        @since ||= now
+        flush if @pending >= @max_tokens || (@max_seconds && now - @since >= @max_seconds)
+        self
+      end
+
+      def locked(&block)
+        @lock ? @lock.synchronize(&block) : yield
+      end
+
+      def now
+        Process.clock_gettime(Process::CLOCK_MONOTONIC)
+      end
+    end
+  end
+end
@@ -0,0 +1,88 @@
+# License::   LGPL
+
+module Classifier
+  # A Cascade classifies with a Bayes classifier first, and only asks an LSI
+  # index about the texts Bayes is unsure of. Bayes is cheap but easily
+  # misled by shared vocabulary, while LSI classify scores the text against
+  # every indexed item, so sending LSI only the close calls gives most of its
+  # accuracy for little more than the cost of Bayes:
+  #
+  #   cascade = Classifier::Cascade.new bayes, lsi, :margin => 2.0
+  #   cascade.classify "This text revolves around dogs."
+  #   cascade.stats[:lsi][:decided]   # => how many texts LSI had to decide
+  #
+  # Bayes is trusted when its best score beats the runner-up by at least
+  # :margin (1.0 by default). Scores are log probabilities, so the margin is
+  # a log odds ratio: a margin of 1.0 means the best category is e times as
+  # likely as the next. If LSI has no answer, the Bayes answer stands.
+  #
+  # Both stages answer in the form Bayes#classify does. LSI categories are
+  # whatever objects the items were indexed with, so they are named as
+  # Bayes names its categories: :not_spam, "not_spam" and "Not spam" all
+  # come back as "Not spam".
+  class Cascade
+    attr_reader :bayes, :lsi
+    attr_accessor :margin
+
+    def initialize(bayes, lsi, options = {})
+      @bayes, @lsi = bayes, lsi
+      @margin = options[:margin] || 1.0
+      @lock = Mutex.new
+      reset_stats
+    end
+
+    # Returns the category of +text+, as Bayes#classify or LSI#classify
+    # would.
+    def classify(text)
+      classify_with_stage(text).first
+    end
+
+    # Returns the category of +text+ and the stage that decided it, :bayes
+    # or :lsi.
+    def classify_with_stage(text)
+      started = now
+      ranked = @bayes.classifications(text).sort_by { |category, score| -score }
+      best = ranked[0] && ranked[0][0]
+      confident = ranked.size < 2 || ranked[0][1] - ranked[1][1] >= @margin
+      record :bayes, started, confident
+      return best, :bayes if confident
+
+      started = now
+      category = @lsi.classify(text)
+      record :lsi, started, !category.nil?
+      category.nil? ? [best, :bayes] : [category.to_s.prepare_category_name.to_s, :lsi]
+    end
+
+    # Returns, for each stage, the number of texts it was called for, the
+    # number it decided, and the seconds spent in it. Bayes is called for
+    # every text; LSI only for those below the margin.
+    def stats
+      @lock.synchronize do
+        @stats.inject({}) { |copy, (stage, counts)| copy.update(stage => counts.dup) }
+      end
+    end
+
+    def reset_stats
+      @lock.synchronize do
+        @stats = {}
+        [:bayes, :lsi].each { |stage| @stats[stage] = { :calls => 0, :decided => 0, :seconds => 0.0 } }
+      end
+    end
+
+    private
+
+    def record(stage, started, decided)
+      elapsed = now - started
+      @lock.synchronize do
+        counts = @stats[stage]
+        counts[:calls] += 1
+        counts[:decided] += 1 if decided
+        counts[:seconds] += elapsed
+      end
+    end
+
+    def now
+      Process.clock_gettime(Process::CLOCK_MONOTONIC)
+    end
+  end
+end
@@ -0,0 +1,88 @@
+# License::   LGPL
+
+module Classifier
+  # Readers for corpora that have already been tokenized elsewhere. Each one
+  # streams documents from an IO as term counts, ready for Bayes#train_counts
+  # or LSI#add_item_counts, so bulk training never re-tokenizes any text:
+  #
+  #   File.open("train.svm") do |io|
+  #     Classifier::Corpus.each_libsvm(io) { |label, counts| b.train_counts label, counts }
+  #   end
+  #
+  # Formats that identify terms by number accept an optional +terms+ Array,
+  # where terms[number] names the term; otherwise the number itself, as a
+  # String, is the term.
+  # Without a block, each reader returns an Enumerator.
+  module Corpus
+    module_function
+
+    # Reads libsvm/svmlight lines of the form
+    #   label index:count index:count ... # optional comment
+    # yielding the label and a Hash of term => count for each line.
+    def each_libsvm(io, terms = nil)
+      return enum_for(:each_libsvm, io, terms) unless block_given?
+      io.each_line do |line|
+        fields = line.sub(/#.*/, "").split
+        next if fields.empty?
+        label = fields.shift
+        counts = Hash.new(0)
+        fields.each do |field|
+          index, count = field.split(":", 2)
+          counts[term_for(index, terms)] += number(count)
+        end
+        yield label, counts
+      end
+    end
+
+    # Reads a MatrixMarket coordinate file whose rows are documents and whose
+    # columns are terms (pass :transpose => true for a term-document file),
+    # yielding the 1-based document number and a Hash of term => count for
+    # every document with at least one entry, in document order. Entries need
+    # not be sorted, so they are grouped in memory before being yielded.
+    def each_matrix_market(io, terms = nil, options = {})
+      return enum_for(:each_matrix_market, io, terms, options) unless block_given?
+      header = io.gets
+      unless header =~ /^%%MatrixMarket\s+matrix\s+coordinate/i
+        raise ArgumentError, "Not a MatrixMarket coordinate file: #{header.to_s.strip}"
+      end
+      size_seen = false
+      docs = Hash.new { |hash, doc| hash[doc] = Hash.new(0) }
+      io.each_line do |line|
+        next if line =~ /^\s*(%|$)/
+        unless size_seen
+          size_seen = true
+          next
+        end
+        row, col, count = line.split
+        doc, term = options[:transpose] ? [col, row] : [row, col]
+        docs[doc.to_i][term_for(term, terms)] += count ? number(count) : 1
+      end
+      docs.keys.sort.each { |doc| yield doc, docs[doc] }
+    end
+
+    # Reads one JSON object per line, yielding its label and term counts.
+    # The label is taken from "label" (or "category"), and the counts from
+    # "counts", given either as an object of term => count or as an array
+    # of [term, count] pairs. The whole record is yielded third, for any
+    # other fields such as a document id.
+    def each_jsonl(io)
+      return enum_for(:each_jsonl, io) unless block_given?
+      require 'json'
+      io.each_line do |line|
+        next if line.strip.empty?
+        record = JSON.parse(line)
+        yield record["label"] || record["category"], record["counts"], record
+      end
+    end
+
+    def term_for(index, terms)
+      (terms && terms[index.to_i]) || index
+    end
+
+    def number(string)
+      string =~ /[.eE]/ ? string.to_f : string.to_i
+    end
+
+    private_class_method :term_for, :number
+  end
+end
@@ -4,6 +4,7 @@
 
 require 'fast_stemmer'
 require 'classifier/extensions/word_hash'
+require 'classifier/extensions/word_stream'
 
 class Object
 	def prepare_category_name; to_s.gsub("_"," ").capitalize.intern end
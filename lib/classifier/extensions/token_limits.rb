@@ -0,0 +1,64 @@
+# License::   LGPL
+
+module Classifier
+  # Bounds on the work of tokenizing any single text, so that one huge
+  # attachment or base64 blob cannot stall a classifier. Every tokenizing
+  # method (String#each_word and the methods built on it, and their
+  # WordStream counterparts) obeys them, so they bound Bayes#classify,
+  # LSI#classify and training alike:
+  #
+  #   Classifier::TokenLimits.max_bytes        = 256 * 1024
+  #   Classifier::TokenLimits.max_tokens       = 20_000
+  #   Classifier::TokenLimits.max_token_length = 40
+  #   Classifier::TokenLimits.sample           = 8
+  #
+  # max_bytes::        only this many bytes of a text are examined.
+  # max_tokens::       at most this many distinct tokens are yielded; further
+  #                    new tokens are dropped, known ones still counted.
+  # max_token_length:: longer words and symbol runs are skipped before they
+  #                    are stemmed.
+  # sample::           the max_bytes of a longer text are taken as this many
+  #                    windows spread evenly over it, rather than from its
+  #                    head. Streams are always read from the head.
+  #
+  # All of them are off (nil) by default.
+  module TokenLimits
+    class << self
+      attr_accessor :max_bytes, :max_tokens, :max_token_length, :sample
+
+      # Returns +text+ cut down to max_bytes, and +block+ wrapped to obey
+      # max_tokens.
+      def apply(text, block)
+        text = bound(text) if max_bytes && text.bytesize > max_bytes
+        return text, distinct(block)
+      end
+
+      # Returns +block+ wrapped so that it is given at most max_tokens
+      # distinct tokens, or +block+ itself if there is no such limit.
+      def distinct(block)
+        return block unless max_tokens
+        limit, seen = max_tokens, Hash.new
+        lambda do |token|
+          next unless seen[token] || seen.size < limit
+          seen[token] = true
+          block.call(token)
+        end
+      end
+
+      private
+
+      def bound(text)
+        windows = sample.to_i
+        if windows > 1
+          size = max_bytes.div(windows)
+          stride = (text.bytesize - size).div(windows - 1)
+          text = Array.new(windows) { |i| text.byteslice(i * stride, size) }.join(" ")
+        else
+          text = text.byteslice(0, max_bytes)
+        end
+        # A cut may fall inside a character.
+        text.valid_encoding? ? text : text.scrub("")
+      end
+    end
+  end
+end
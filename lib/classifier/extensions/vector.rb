@@ -45,6 +45,9 @@ class Matrix
 
   alias :trans :transpose
 
+  # Singular value decomposition by Jacobi rotations. If a block is given it
+  # is called after every row of rotations, so a long decomposition can be
+  # interleaved with other work.
   def SV_decomp(maxSweeps = 20)
     if self.row_size >= self.column_size
       q = self.trans * self
@@ -52,56 +55,47 @@ class Matrix
       q = self * self.trans
     end
 
-    qrot    = q.dup
-    v       = Matrix.identity(q.row_size)
-    azrot   = nil
-    mzrot   = nil
+    n       = q.row_size
+    qrot    = q.to_a.collect { |r| r.collect { |x| x.to_f } }
+    v       = Matrix.identity(n).to_a
     cnt     = 0
     s_old   = nil
-    mu      = nil
 
     while true do
       cnt += 1
-      for row in (0...qrot.row_size-1) do
-        for col in (1..qrot.row_size-1) do
-          next if row == col
-          h = Math.atan((2 * qrot[row,col])/(qrot[row,row]-qrot[col,col]))/2.0
+      for row in (0...n-1) do
+        for col in (1..n-1) do
+          next if row == col or qrot[row][col] == 0
+          h = Math.atan((2 * qrot[row][col])/(qrot[row][row]-qrot[col][col]))/2.0
           hcos = Math.cos(h)
           hsin = Math.sin(h)
-          mzrot = Matrix.identity(qrot.row_size)
-          mzrot[row,row] = hcos
-          mzrot[row,col] = -hsin
-          mzrot[col,row] = hsin
-          mzrot[col,col] = hcos
-          qrot = mzrot.trans * qrot * mzrot
-          v = v * mzrot
+          # qrot = R' * qrot * R and v = v * R for the rotation R in the
+          # (row, col) plane, which only touches those two rows and columns.
+          rotate_columns(qrot, row, col, hcos, hsin)
+          rotate_rows(qrot, row, col, hcos, hsin)
+          rotate_columns(v, row, col, hcos, hsin)
         end
+        yield if block_given?
       end
-      s_old = qrot.dup if cnt == 1
+      s_old = (0...n).collect { |r| qrot[r][r] } if cnt == 1
       sum_qrot = 0.0
       if cnt > 1
-        qrot.row_size.times do |r|
-          sum_qrot += (qrot[r,r]-s_old[r,r]).abs if (qrot[r,r]-s_old[r,r]).abs > 0.001
+        n.times do |r|
+          sum_qrot += (qrot[r][r]-s_old[r]).abs if (qrot[r][r]-s_old[r]).abs > 0.001
         end
-        s_old = qrot.dup
+        s_old = (0...n).collect { |r| qrot[r][r] }
       end
       break if (sum_qrot <= 0.001 and cnt > 1) or cnt >= maxSweeps
     end # of do while true
     s = []
-    qrot.row_size.times do |r|
-      s << Math.sqrt(qrot[r,r])
+    n.times do |r|
+      s << Math.sqrt(qrot[r][r])
     end
-    #puts "cnt = #{cnt}"
+    v = Matrix.rows(v)
     if self.row_size >= self.column_size
       mu = self *  v * Matrix.diagonal(*s).inverse
       return [mu, v, s]
     else
-      puts v.row_size
-      puts v.column_size
-      puts self.row_size
-      puts self.column_size
-      puts s.size
-
       mu = (self.trans * v *  Matrix.diagonal(*s).inverse)
       return [mu, v, s]
     end
@@ -109,4 +103,27 @@ class Matrix
   def []=(i,j,val)
     @rows[i][j] = val
   end
+
+  private
+
+  # Replaces columns a and b of the row arrays m with their rotation by
+  # the given cosine and sine.
+  def rotate_columns(m, a, b, cos, sin)
+    m.each do |r|
+      ra, rb = r[a], r[b]
+      r[a] = cos * ra + sin * rb
+      r[b] = cos * rb - sin * ra
+    end
+  end
+
+  # Replaces rows a and b of the row arrays m with their rotation by the
+  # given cosine and sine.
+  def rotate_rows(m, a, b, cos, sin)
+    ra, rb = m[a], m[b]
+    ra.size.times do |j|
+      x, y = ra[j], rb[j]
+      ra[j] = cos * x + sin * y
+      rb[j] = cos * y - sin * x
+    end
+  end
 end
@@ -1,12 +1,14 @@
 module GSL
 
   class Vector
+    # Vectors dump as packed doubles behind a marker byte. Older dumps were
+    # a marshaled Array, which never starts with that byte.
     def _dump(v)
-      Marshal.dump( self.to_a )
+      "\0" + self.to_a.pack('E*')
     end
 
     def self._load(arr)
-      arry = Marshal.load(arr)
+      arry = arr.start_with?("\0") ? arr[1..-1].unpack('E*') : Marshal.load(arr)
       return GSL::Vector.alloc(arry)
     end
 
@@ -3,6 +3,7 @@
 # License::   LGPL
 
 require "set"
+require "classifier/extensions/token_limits"
 
 # These are extensions to the String class to provide convenience
 # methods for the Classifier package.
@@ -19,38 +20,74 @@ class String
   # Return a Hash of strings => ints. Each word in the string is stemmed,
   # interned, and indexes to its frequency in the document.
 	def word_hash
-		word_hash = clean_word_hash()
-		symbol_hash = word_hash_for_symbols(gsub(/[\w]/," ").split)
-		return word_hash.merge(symbol_hash)
+		d = Hash.new(0)
+		each_word { |word| d[word.intern] += 1 }
+		return d
 	end
 
 	# Return a word hash without extra punctuation or short symbols, just stemmed words
 	def clean_word_hash
-		word_hash_for_words gsub(/[^\w\s]/,"").split
+		d = Hash.new(0)
+		each_clean_word { |word| d[word.intern] += 1 }
+		return d
 	end
 
-	private
+	# Like word_hash, but keyed by the ids +vocabulary+ assigns to each token
+	# instead of by Symbols. Tokens new to the vocabulary are added to it,
+	# unless +grow+ is false or the vocabulary is frozen, in which case they
+	# are left out.
+	def word_ids(vocabulary, grow = true)
+		d = Hash.new(0)
+		each_word { |word| id = grow ? vocabulary.add(word) : vocabulary[word]; d[id] += 1 if id }
+		return d
+	end
 
-	def word_hash_for_words(words)
+	# The clean_word_hash counterpart of word_ids.
+	def clean_word_ids(vocabulary, grow = true)
 		d = Hash.new(0)
-		words.each do |word|
-			word.downcase!
-			if ! CORPUS_SKIP_WORDS.include?(word) && word.length > 2
-				d[word.stem.intern] += 1
-			end
-		end
+		each_clean_word { |word| id = grow ? vocabulary.add(word) : vocabulary[word]; d[id] += 1 if id }
 		return d
 	end
 
+	# Yields every token word_hash counts: each stemmed word, then each
+	# punctuation symbol. The work done is bounded by
+	# Classifier::TokenLimits, as it is for the other tokenizing methods.
+	def each_word(&block)
+		text, block = Classifier::TokenLimits.apply(self, block)
+		text.scan_clean_words(&block)
+		text.scan_symbols(&block)
+	end
+
+	# Yields every run of punctuation symbols word_hash counts.
+	def each_symbol(&block)
+		text, block = Classifier::TokenLimits.apply(self, block)
+		text.scan_symbols(&block)
+	end
 
-	def word_hash_for_symbols(words)
-		d = Hash.new(0)
-		words.each do |word|
-			d[word.intern] += 1
+	# Yields every stemmed word clean_word_hash counts.
+	def each_clean_word(&block)
+		text, block = Classifier::TokenLimits.apply(self, block)
+		text.scan_clean_words(&block)
+	end
+
+	# The tokenizers proper, with only the token length limit applied; the
+	# others are up to the caller.
+	def scan_symbols # :nodoc:
+		limit = Classifier::TokenLimits.max_token_length
+		gsub(/[\w]/," ").split.each { |symbol| yield symbol unless limit && symbol.length > limit }
+	end
+
+	def scan_clean_words # :nodoc:
+		limit = Classifier::TokenLimits.max_token_length
+		gsub(/[^\w\s]/,"").split.each do |word|
+			next if limit && word.length > limit
+			word.downcase!
+			yield word.stem if ! CORPUS_SKIP_WORDS.include?(word) && word.length > 2
 		end
-		return d
 	end
 
+	private
+
 	CORPUS_SKIP_WORDS = Set.new([
       "a",
       "again",
@@ -0,0 +1,129 @@
+# License::   LGPL
+
+require 'stringio'
+
+module Classifier
+  # The tokenizing methods of String, for IO and StringIO. Rather than
+  # reading a whole file into a String first, they read it in chunks of
+  # chunk_size bytes, so training on or classifying a large file never holds
+  # more than a chunk of it in memory:
+  #
+  #   File.open("message.eml") { |f| b.train :spam, f }
+  #   File.open("message.eml") { |f| b.classify f }
+  #
+  # Tokens never span whitespace, so each chunk is cut after its last
+  # whitespace character and the rest is carried over to the next one, which
+  # also keeps multibyte characters whole. A run without any whitespace is
+  # carried over only up to MAX_RUN bytes; it is then tokenized as it is,
+  # and the rest of it is skipped up to the next whitespace. Text is tokenized in the IO's
+  # external encoding, and from its current position to its end, or until
+  # Classifier::TokenLimits.max_bytes have been read.
+  module WordStream
+    MAX_RUN    = 64 * 1024
+    WHITESPACE = /[ \t\r\n\f\v]/
+
+    class << self
+      # Bytes read at a time, 64 KB by default.
+      attr_accessor :chunk_size
+
+      # Given the binary text carried over so far, and the next binary chunk
+      # read, returns the text that is ready to be tokenized (or nil) and the
+      # text to carry over now. Only the chunk is searched for whitespace,
+      # since carried text never has any. While the rest of an overlong run
+      # is being skipped, what is carried over is nil. Bayes::Session cuts
+      # the chunks it is fed this way too.
+      def cut(carry, chunk) # :nodoc:
+        unless carry
+          space = chunk.index(WHITESPACE)
+          return nil, nil unless space
+          carry, chunk = "".b, chunk.byteslice(space, chunk.bytesize - space)
+        end
+        space = chunk.rindex(WHITESPACE)
+        if space
+          ready = carry << chunk.byteslice(0, space + 1)
+          carry = chunk.byteslice(space + 1, chunk.bytesize - space - 1)
+        else
+          ready, carry = nil, carry << chunk
+        end
+        return ready, carry if carry.bytesize <= MAX_RUN
+        return (ready || "".b) << carry.byteslice(0, MAX_RUN), nil
+      end
+    end
+    self.chunk_size = 65536
+
+    # See String#word_hash.
+    def word_hash
+      d = Hash.new(0)
+      each_word { |word| d[word.intern] += 1 }
+      return d
+    end
+
+    # See String#clean_word_hash.
+    def clean_word_hash
+      d = Hash.new(0)
+      each_clean_word { |word| d[word.intern] += 1 }
+      return d
+    end
+
+    # See String#word_ids.
+    def word_ids(vocabulary, grow = true)
+      d = Hash.new(0)
+      each_word { |word| id = grow ? vocabulary.add(word) : vocabulary[word]; d[id] += 1 if id }
+      return d
+    end
+
+    # See String#clean_word_ids.
+    def clean_word_ids(vocabulary, grow = true)
+      d = Hash.new(0)
+      each_clean_word { |word| id = grow ? vocabulary.add(word) : vocabulary[word]; d[id] += 1 if id }
+      return d
+    end
+
+    # Yields the same tokens as String#each_word, as many times each: the
+    # symbols are held back until every word has been yielded. They are
+    # only counted meanwhile, and come out in the order they first appeared.
+    def each_word(&block)
+      block = TokenLimits.distinct(block)
+      symbols = Hash.new(0)
+      each_chunk do |chunk|
+        chunk.scan_clean_words(&block)
+        chunk.scan_symbols { |symbol| symbols[symbol] += 1 }
+      end
+      symbols.each { |symbol, count| count.times { block.call(symbol) } }
+    end
+
+    def each_clean_word(&block)
+      block = TokenLimits.distinct(block)
+      each_chunk { |chunk| chunk.scan_clean_words(&block) }
+    end
+
+    private
+
+    def each_chunk
+      encoding = external_encoding || Encoding.default_external
+      carry = "".b
+      left = TokenLimits.max_bytes
+      while (left.nil? || left > 0) && (data = read(left ? [WordStream.chunk_size, left].min : WordStream.chunk_size))
+        left -= data.bytesize if left
+        ready, carry = WordStream.cut(carry, data.b)
+        yield valid(ready, encoding) if ready
+      end
+      yield valid(carry, encoding) unless carry.nil? || carry.empty?
+    end
+
+    # Reading may have stopped inside a character, and so may an overlong
+    # run that was cut short.
+    def valid(text, encoding)
+      text.force_encoding(encoding)
+      text.valid_encoding? ? text : text.scrub("")
+    end
+  end
+end
+
+class IO
+  include Classifier::WordStream
+end
+
+class StringIO
+  include Classifier::WordStream
+end
@@ -0,0 +1,108 @@
+# License::   LGPL
+
+module Classifier
+  # A Handle holds the model a server classifies with, and lets a newly
+  # trained one be swapped in without a restart. Calls made through the
+  # handle, such as classify or search, go to whichever model is current when
+  # they start, and finish on that model even if another is swapped in
+  # meanwhile:
+  #
+  #   handle = Classifier::Handle.load "spam.model"
+  #   handle.classify "Some text"
+  #
+  #   # later, once a new model has been written
+  #   handle.reload "spam.model"
+  #
+  # Models are loaded with Marshal. #reload reads and loads the file in a
+  # background thread, so requests keep being served by the old model until
+  # the new one is ready. The old model is released once the last call still
+  # using it returns: the handle drops it, and calls the :on_release option
+  # with it, for example to close a Bayes::DiskStore.
+  class Handle
+    # A model and the number of calls reading it. A retired generation has
+    # been swapped out, and is released when its readers reach zero.
+    Generation = Struct.new(:model, :readers, :retired)
+
+    # Returns a handle for the model Marshal-ed to +path+.
+    def self.load(path, options = {})
+      new(Marshal.load(File.binread(path)), options)
+    end
+
+    def initialize(model, options = {})
+      @on_release = options[:on_release]
+      @lock = Mutex.new
+      @current = Generation.new(model, 0, false)
+    end
+
+    # Returns the current model. To make several calls against the same
+    # model, use #with instead.
+    def model
+      @current.model
+    end
+
+    # Yields the current model, which is kept from being released until the
+    # block returns.
+    def with
+      generation = acquire
+      yield generation.model
+    ensure
+      release generation if generation
+    end
+
+    # Makes +model+ current. The old model is released right away if
+    # nothing is reading it, or else by the last call to finish with it.
+    def swap(model)
+      old = @lock.synchronize do
+        old, @current = @current, Generation.new(model, 0, false)
+        old.retired = true
+        old if old.readers == 0
+      end
+      retire old if old
+      self
+    end
+
+    # Loads the model Marshal-ed to +path+ in a background thread and swaps
+    # it in, returning the thread; join it to wait for the swap. If loading
+    # fails, the current model stays, and joining raises the error.
+    def reload(path)
+      thread = Thread.new { swap Marshal.load(File.binread(path)) }
+      thread.report_on_exception = false
+      thread
+    end
+
+    # Calls made on the handle go to the current model.
+    def method_missing(name, *args, &block)
+      if model.respond_to?(name)
+        with { |m| m.public_send(name, *args, &block) }
+      else
+        super
+      end
+    end
+
+    def respond_to_missing?(name, include_private = false)
+      model.respond_to?(name) || super
+    end
+
+    private
+
+    def acquire
+      @lock.synchronize do
+        @current.readers += 1
+        @current
+      end
+    end
+
+    def release(generation)
+      drained = @lock.synchronize do
+        generation.readers -= 1
+        generation.retired && generation.readers == 0
+      end
+      retire generation if drained
+    end
+
+    def retire(generation)
+      model, generation.model = generation.model, nil
+      @on_release.call(model) if @on_release
+    end
+  end
+end
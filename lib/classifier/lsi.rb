@@ -18,6 +18,9 @@ end
 require 'classifier/lsi/word_list'
 require 'classifier/lsi/content_node'
 require 'classifier/lsi/summary'
+require 'classifier/lsi/budget'
+require 'classifier/lsi/term_vectors'
+require 'digest/sha1'
 
 module Classifier
 
@@ -26,24 +29,60 @@ module Classifier
   # please consult Wikipedia[http://en.wikipedia.org/wiki/Latent_Semantic_Indexing].
   class LSI
 
-    attr_reader :word_list
+    # A published index: the handles of the items it covers, their nodes
+    # and the items themselves by handle, and the structures built alongside
+    # them. Snapshots are never modified.
+    Snapshot = Struct.new(:version, :handles, :nodes, :item_for, :word_list, :term_vectors, :clusters)
+
     attr_accessor :auto_rebuild
 
     # Create a fresh index.
     # If you want to call #build_index manually, use
     #      Classifier::LSI.new :auto_rebuild => false
     #
+    # Words are stored by their id in a Classifier::Vocabulary, which may be
+    # shared with other classifiers by passing it as :vocabulary.
+    #
+    # To keep the last few built indexes around for rollback_to, pass the
+    # number to keep as :versions (by default only the current one is kept).
+    #
+    # Internally every item is known by an Integer handle, which add_item
+    # returns, so the index never hashes or compares whole documents while
+    # it works. Handles are never reused: one that belonged to a removed item
+    # finds nothing, rather than another item. When the items are the documents themselves, the index need
+    # not keep them either: with :retain_items => false, String items are
+    # remembered only by a digest, and the results of search, find_related
+    # and the like are handles rather than items.
+    #
     def initialize(options = {})
       @auto_rebuild = true unless options[:auto_rebuild] == false
-      @word_list, @items = WordList.new, {}
+      @vocabulary = options[:vocabulary] || Vocabulary.new
+      @retain_items = options[:retain_items] != false
+      @word_list = WordList.new(@vocabulary)
+      @handles, @nodes, @item_for = {}, {}, {}
+      @next_handle = 0
       @version, @built_at_version = 0, -1
+      @max_versions, @snapshots = options[:versions] || 1, []
+    end
+
+    # Returns the WordList mapping word ids to dimensions of the index.
+    def word_list
+      upgrade_items
+      @word_list
+    end
+
+    # Returns the Classifier::Vocabulary holding the words of the index.
+    def vocabulary
+      upgrade_items
+      @vocabulary
     end
 
     # Returns true if the index needs to be rebuilt.  The index needs
     # to be built after all informaton is added, but before you start
     # using it for search, classification and cluster detection.
     def needs_rebuild?
-      (@items.keys.size > 1) && (@version != @built_at_version)
+      upgrade_items
+      (@handles.size > 1) && (@version != @built_at_version)
     end
 
     # Adds an item to the index. item is assumed to be a string, but
@@ -59,11 +98,24 @@ module Classifier
     #   ar = ActiveRecordObject.find( :all )
     #   lsi.add_item ar, *ar.categories { |x| ar.content }
     #
+    # Returns the handle of the item.
     def add_item( item, *categories, &block )
-      clean_word_hash = block ? block.call(item).clean_word_hash : item.to_s.clean_word_hash
-      @items[item] = ContentNode.new(clean_word_hash, *categories)
-      @version += 1
-      build_index if @auto_rebuild
+      upgrade_items
+      word_ids = block ? block.call(item).clean_word_ids(@vocabulary) : item.to_s.clean_word_ids(@vocabulary)
+      store_item item, ContentNode.new(word_ids, *categories)
+    end
+
+    # Adds an item to the index from pre-tokenized term counts, rather than by
+    # tokenizing its text. counts may be a Hash or an Array of term/count
+    # pairs; the terms are used as given, without stemming. Integer terms
+    # are taken to be vocabulary ids, as in Vocabulary#ids_for.
+    #
+    # For example:
+    #   lsi.add_item_counts "doc-17", { "dog" => 2, "bark" => 1 }, "Dog"
+    #
+    def add_item_counts( item, counts, *categories )
+      upgrade_items
+      store_item item, ContentNode.new(@vocabulary.ids_for(counts), *categories)
     end
 
     # A less flexible shorthand for add_item that assumes
@@ -76,30 +128,61 @@ module Classifier
 
     # Returns the categories for a given indexed items. You are free to add and remove
     # items from this as you see fit. It does not invalide an index to change its categories.
+    #
+    # The categories of a built index are shared with its snapshot, so the
+    # node is copied the first time its categories are asked for.
     def categories_for(item)
-      return [] unless @items[item]
-      return @items[item].categories
+      handle = handle_for( item )
+      node = handle && @nodes[handle]
+      return [] unless node
+      if node.categories.frozen?
+        writable_index
+        node = @nodes[handle] = node.dup
+      end
+      return node.categories
     end
 
     # Removes an item from the database, if it is indexed.
     #
     def remove_item( item )
-      if @items.keys.contain? item
-        @items.remove item
+      upgrade_items
+      key = key_for( item )
+      if @handles.has_key? key
+        handle = writable_index.delete key
+        @nodes.delete handle
+        @item_for.delete handle
         @version += 1
       end
     end
 
-    # Returns an array of items that are indexed.
+    # Returns an array of items that are indexed (or their handles, for
+    # items that are not retained).
     def items
-      @items.keys
+      upgrade_items
+      @handles.values.collect { |handle| item_at( handle ) }
     end
 
-    # Returns the categories for a given indexed items. You are free to add and remove
-    # items from this as you see fit. It does not invalide an index to change its categories.
-    def categories_for(item)
-      return [] unless @items[item]
-      return @items[item].categories
+    # Returns the handle of an indexed item, or nil.
+    def handle_for( item )
+      upgrade_items
+      @handles[key_for( item )]
+    end
+
+    # Returns the item with the given handle, or nil if it is not retained.
+    def item_for( handle )
+      upgrade_items
+      @item_for[handle]
+    end
+
+    def marshal_dump
+      state = Hash.new
+      instance_variables.each { |name| state[name] = instance_variable_get(name) }
+      state
+    end
+
+    def marshal_load( state )
+      state.each { |name, value| instance_variable_set(name, value) }
+      freeze_snapshots
     end
 
     # This function rebuilds the index if needs_rebuild? returns true.
@@ -117,32 +200,49 @@ module Classifier
     # A value of 1 for cutoff means that no semantic analysis will take place,
     # turning the LSI class into a simple vector search engine.
     def build_index( cutoff=0.75 )
-      return unless needs_rebuild?
-      make_word_list
-
-      doc_list = @items.values
-      tda = doc_list.collect { |node| node.raw_vector_with( @word_list ) }
-
-      if $GSL
-         tdm = GSL::Matrix.alloc(*tda).trans
-         ntdm = build_reduced_matrix(tdm, cutoff)
+      rebuild_index( cutoff )
+    end
 
-         ntdm.size[1].times do |col|
-           vec = GSL::Vector.alloc( ntdm.column(col) ).row
-           doc_list[col].lsi_vector = vec
-           doc_list[col].lsi_norm = vec.normalize
-         end
-      else
-         tdm = Matrix.rows(tda).trans
-         ntdm = build_reduced_matrix(tdm, cutoff)
+    # Rebuilds the index just like build_index, but in bounded slices so that
+    # a long rebuild does not monopolize its thread or event loop. After every
+    # +slice+ documents, and after every row of rotations in the SVD, it calls
+    # the given block or, without one, yields to the current Fiber scheduler
+    # (or to other threads when there is no scheduler).
+    #
+    # For example, inside an Async reactor:
+    #   Async { lsi.build_index_cooperatively }
+    #
+    # Items added or removed while the rebuild is paused will leave the index
+    # needing another rebuild. GSL's SVD cannot be interrupted, so with GSL
+    # installed the decomposition itself still runs as a single slice.
+    def build_index_cooperatively( cutoff=0.75, slice=100, &pause )
+      rebuild_index( cutoff, slice, pause || method(:yield_to_scheduler) )
+    end
 
-         ntdm.row_size.times do |col|
-           doc_list[col].lsi_vector = ntdm.column(col) if doc_list[col]
-           doc_list[col].lsi_norm = ntdm.column(col).normalize  if doc_list[col]
-         end
-      end
+    # Returns the versions of the built indexes that can be rolled back to,
+    # oldest first. The last is the one in use, unless items have been added
+    # or removed since it was built.
+    def versions
+      snapshots.collect { |snapshot| snapshot.version }
+    end
 
+    # Switches back to the index built at +version+ (one of #versions),
+    # with the items it covered, discarding any changes made since. This is
+    # only a swap of references; nothing is rebuilt. Rolling back does not
+    # remove later versions, so it is possible to roll forward again.
+    #
+    # Snapshots are part of the LSI object, so they are saved along with it
+    # by Marshal, sharing whatever they have in common.
+    def rollback_to( version )
+      upgrade_items
+      snapshot = snapshots.find { |s| s.version == version }
+      raise ArgumentError, "No index version #{version} to roll back to" unless snapshot
+      @handles, @nodes, @item_for = snapshot.handles, snapshot.nodes, snapshot.item_for
+      @word_list, @term_vectors, @clusters = snapshot.word_list, snapshot.term_vectors, snapshot.clusters
+      # A fresh version number keeps later builds from reusing old ones.
+      @version += 1
       @built_at_version = @version
+      self
     end
 
     # This method returns max_chunks entries, ordered by their average semantic rating.
@@ -157,9 +257,12 @@ module Classifier
        return [] if needs_rebuild?
 
        avg_density = Hash.new
-       @items.each_key { |x| avg_density[x] = proximity_array_for_content(x).inject(0.0) { |x,y| x + y[1]} }
+       @handles.each_value do |handle|
+         node = @nodes[handle]
+         avg_density[handle] = score_items( node, nil ) { |other| dot( node.search_vector, other.search_vector ) }.inject(0.0) { |x,y| x + y[1]}
+       end
 
-       avg_density.keys.sort_by { |x| avg_density[x] }.reverse[0..max_chunks-1].map
+       avg_density.keys.sort_by { |x| avg_density[x] }.reverse[0..max_chunks-1].collect { |handle| item_at( handle ) }
     end
 
     # This function is the primitive that find_related and classify
@@ -174,20 +277,11 @@ module Classifier
     # The parameter doc is the content to compare. If that content is not
     # indexed, you can pass an optional block to define how to create the
     # text data. See add_item for examples of how this works.
-    def proximity_array_for_content( doc, &block )
-      return [] if needs_rebuild?
-
-      content_node = node_for_content( doc, &block )
-      result =
-        @items.keys.collect do |item|
-          if $GSL
-             val = content_node.search_vector * @items[item].search_vector.col
-          else
-             val = (Matrix[content_node.search_vector] * @items[item].search_vector)[0]
-          end
-          [item, val]
-        end
-      result.sort_by { |x| x[1] }.reverse
+    #
+    # An optional Budget limits how long the scan may take; when it runs
+    # out, only the items scored so far are returned. See Budget.
+    def proximity_array_for_content( doc, budget=nil, &block )
+      with_items( proximity_by_handle( doc, budget, &block ) )
     end
 
     # Similar to proximity_array_for_content, this function takes similar
@@ -195,20 +289,8 @@ module Classifier
     # calculated vectors instead of their full versions. This is useful when
     # you're trying to perform operations on content that is much smaller than
     # the text you're working with. search uses this primitive.
-    def proximity_norms_for_content( doc, &block )
-      return [] if needs_rebuild?
-
-      content_node = node_for_content( doc, &block )
-      result =
-        @items.keys.collect do |item|
-          if $GSL
-            val = content_node.search_norm * @items[item].search_norm.col
-          else
-            val = (Matrix[content_node.search_norm] * @items[item].search_norm)[0]
-          end
-          [item, val]
-        end
-      result.sort_by { |x| x[1] }.reverse
+    def proximity_norms_for_content( doc, budget=nil, &block )
+      with_items( norms_by_handle( doc, budget, &block ) )
     end
 
     # This function allows for text-based search of your index. Unlike other functions
@@ -218,11 +300,13 @@ module Classifier
     #
     # While this may seem backwards compared to the other functions that LSI supports,
     # it is actually the same algorithm, just applied on a smaller document.
-    def search( string, max_nearest=3 )
+    #
+    # Like find_related and classify, search accepts an optional Budget.
+    def search( string, max_nearest=3, budget=nil )
       return [] if needs_rebuild?
-      carry = proximity_norms_for_content( string )
+      carry = norms_by_handle( string, budget )
       result = carry.collect { |x| x[0] }
-      return result[0..max_nearest-1]
+      return result[0..max_nearest-1].collect { |handle| item_at( handle ) }
     end
 
     # This function takes content and finds other documents
@@ -234,11 +318,12 @@ module Classifier
     # This is particularly useful for identifing clusters in your document space.
     # For example you may want to identify several "What's Related" items for weblog
     # articles, or find paragraphs that relate to each other in an essay.
-    def find_related( doc, max_nearest=3, &block )
+    def find_related( doc, max_nearest=3, budget=nil, &block )
+      handle = handle_for( doc )
       carry =
-        proximity_array_for_content( doc, &block ).reject { |pair| pair[0] == doc }
+        proximity_by_handle( doc, budget, handle, &block ).reject { |pair| pair[0] == handle }
       result = carry.collect { |x| x[0] }
-      return result[0..max_nearest-1]
+      return result[0..max_nearest-1].collect { |h| item_at( h ) }
     end
 
     # This function uses a voting system to categorize documents, based on
@@ -250,13 +335,14 @@ module Classifier
     # text. A cutoff of 1 means that every document in the index votes on
     # what category the document is in. This may not always make sense.
     #
-    def classify( doc, cutoff=0.30, &block )
-      icutoff = (@items.size * cutoff).round
-      carry = proximity_array_for_content( doc, &block )
+    def classify( doc, cutoff=0.30, budget=nil, &block )
+      upgrade_items
+      icutoff = (@handles.size * cutoff).round
+      carry = proximity_by_handle( doc, budget, &block )
       carry = carry[0..icutoff-1]
       votes = {}
       carry.each do |pair|
-        categories = @items[pair[0]].categories
+        categories = @nodes[pair[0]].categories
         categories.each do |category|
           votes[category] ||= 0.0
           votes[category] += pair[1]
@@ -267,20 +353,226 @@ module Classifier
       return ranking[-1]
     end
 
+    # Returns up to count terms whose meaning in this index is closest to
+    # term, best first, which is useful for query expansion. Terms are
+    # compared by their rows of the reduced SVD (U_k * S_k), which are
+    # precomputed when the index is built. term may be given as a stem or
+    # as a word, which is stemmed if it is not itself in the index.
+    #
+    # For example:
+    #   lsi.related_terms "dogs", 5  # => ["bark", "puppi", ...]
+    def related_terms( term, count=10 )
+      return [] if needs_rebuild? || !@term_vectors || @term_vectors.rank == 0
+      id = @vocabulary[term] || @vocabulary[term.to_s.downcase.stem]
+      dim = id && @word_list[id]
+      return [] unless dim
+      top_indices( @term_vectors.similarities(dim), count, dim ).collect { |d| @word_list.word_for_index(d) }
+    end
+
+    # Returns a Hash mapping every indexed item to its count highest ranked
+    # stems (see highest_ranked_stems), as Strings. This is much cheaper
+    # than calling highest_ranked_stems item by item: the word list is
+    # inverted once, and each item only keeps a running top count.
+    def keywords_for_all( count=3 )
+      return {} if needs_rebuild?
+      words = (0...@word_list.size).collect { |dim| @word_list.word_for_index(dim) }
+      keywords = {}
+      @handles.each_value do |handle|
+        keywords[item_at( handle )] = top_indices( @nodes[handle].search_vector.to_a, count ).collect { |dim| words[dim] }
+      end
+      keywords
+    end
+
     # Prototype, only works on indexed documents.
     # I have no clue if this is going to work, but in theory
     # it's supposed to.
     def highest_ranked_stems( doc, count=3 )
-      raise "Requested stem ranking on non-indexed content!" unless @items[doc]
-      arr = node_for_content(doc).lsi_vector.to_a
-      top_n = arr.sort.reverse[0..count-1]
-      return top_n.collect { |x| @word_list.word_for_index(arr.index(x))}
+      node = indexed_node( doc )
+      raise "Requested stem ranking on non-indexed content!" unless node
+      arr = node.lsi_vector.to_a
+      return top_indices( arr, count ).collect { |dim| @word_list.word_for_index(dim).intern }
     end
 
     private
-    def build_reduced_matrix( matrix, cutoff=0.75 )
+    def rebuild_index( cutoff, slice=nil, pause=nil )
+      return unless needs_rebuild?
+      version = @version
+
+      # The new vectors go into copies of the nodes, leaving those of earlier
+      # versions (and of the index in use while this one is built) intact.
+      keys, handles = @handles.keys, @handles.values
+      originals = handles.collect { |handle| @nodes[handle] }
+      doc_list = originals.collect { |node| node.dup }
+      item_for = @item_for.frozen? ? @item_for : @item_for.dup.freeze
+      word_list = make_word_list( doc_list, slice, pause )
+      tda = []
+      each_in_slices( doc_list, slice, pause ) { |node| tda << node.raw_vector_with( word_list ) }
+
+      if $GSL
+         tdm = GSL::Matrix.alloc(*tda).trans
+         pause.call if pause
+         ntdm, term_vectors = build_reduced_matrix(tdm, cutoff, pause)
+
+         ntdm.size[1].times do |col|
+           vec = GSL::Vector.alloc( ntdm.column(col) ).row
+           doc_list[col].lsi_vector = vec
+           doc_list[col].lsi_norm = normalize( vec )
+         end
+      else
+         tdm = Matrix.rows(tda).trans
+         pause.call if pause
+         ntdm, term_vectors = build_reduced_matrix(tdm, cutoff, pause)
+
+         ntdm.column_size.times do |col|
+           doc_list[col].lsi_vector = ntdm.column(col) if doc_list[col]
+           doc_list[col].lsi_norm = normalize( ntdm.column(col) )  if doc_list[col]
+         end
+      end
+
+      clusters = build_clusters( handles, doc_list, slice, pause )
+      nodes = Hash.new
+      handles.each_with_index { |handle, i| nodes[handle] = doc_list[i] }
+      doc_list.each { |node| node.categories.freeze }
+      snapshot = Snapshot.new( version, Hash[keys.zip(handles)].freeze, nodes.freeze, item_for,
+                               word_list, term_vectors, clusters )
+      publish snapshot, handles, originals
+    end
+
+    # Makes snapshot the index in use, and keeps it for rollback_to.
+    def publish( snapshot, handles, originals )
+      if @version == snapshot.version
+        @handles, @nodes, @item_for = snapshot.handles, snapshot.nodes, snapshot.item_for
+      else
+        # Items were added or removed while a cooperative rebuild paused; they
+        # stay as they are, and the rest take their new nodes.
+        writable_index
+        handles.each_with_index do |handle, i|
+          @nodes[handle] = snapshot.nodes[handle] if @nodes[handle].equal?( originals[i] )
+        end
+      end
+      @word_list, @term_vectors, @clusters = snapshot.word_list, snapshot.term_vectors, snapshot.clusters
+      @built_at_version = snapshot.version
+      snapshots << snapshot
+      snapshots.shift while snapshots.size > (@max_versions || 1)
+    end
+
+    # Nodes and items are kept by handle in Hashes, so that removing an item
+    # frees its entries while handles stay unique. Indexes marshaled before
+    # then count on from the end of their Arrays of nodes.
+    def next_handle
+      @next_handle ||= @nodes.size
+      @next_handle += 1
+      @next_handle - 1
+    end
+
+    # Marshal does not keep objects frozen, so the parts of every snapshot
+    # (which the index in use shares until it is changed) are frozen again
+    # after loading.
+    def freeze_snapshots
+      snapshots.each do |snapshot|
+        [snapshot.handles, snapshot.nodes, snapshot.item_for].each { |part| part.freeze }
+        (snapshot.nodes.is_a?(Hash) ? snapshot.nodes.values : snapshot.nodes).each { |node| node.categories.freeze if node }
+      end
+    end
+
+    # Indexes marshaled before snapshots were kept have none.
+    def snapshots
+      @snapshots ||= []
+    end
+
+    def store_item( item, node )
+      upgrade_items
+      key = key_for( item )
+      handles = writable_index
+      handle = handles[key] ||= next_handle
+      @nodes[handle] = node
+      @item_for[handle] = key.equal?( item ) ? item : nil
+      @version += 1
+      build_index if @auto_rebuild
+      handle
+    end
+
+    # The handles, nodes and items of a published index are frozen, as its
+    # snapshot shares them; they are copied the first time they are changed.
+    # Returns the handles.
+    def writable_index
+      @handles = @handles.dup if @handles.frozen?
+      @nodes = @nodes.dup if @nodes.frozen?
+      @item_for = @item_for.dup if @item_for.frozen?
+      @handles
+    end
+
+    # Items are looked up by themselves, or by their digest when String
+    # items are not retained.
+    def key_for( item )
+      !@retain_items && item.is_a?(String) ? Digest::SHA1.digest( item ) : item
+    end
+
+    def item_at( handle )
+      @item_for[handle] || handle
+    end
+
+    def indexed_node( item )
+      handle = handle_for( item )
+      handle && @nodes[handle]
+    end
+
+    # Turns [handle, score] pairs into [item, score] pairs.
+    def with_items( pairs )
+      pairs.collect { |handle, score| [item_at( handle ), score] }
+    end
+
+    # The handle of doc may be given by a caller that has already looked it
+    # up, so that the document is hashed only once.
+    def proximity_by_handle( doc, budget=nil, handle=handle_for( doc ), &block )
+      return [] if needs_rebuild?
+      budget.start if budget
+
+      content_node = node_for_content( doc, handle, &block )
+      score_items( content_node, budget ) do |node|
+        dot( content_node.search_vector, node.search_vector )
+      end
+    end
+
+    def norms_by_handle( doc, budget=nil, &block )
+      return [] if needs_rebuild?
+      budget.start if budget
+
+      content_node = node_for_content( doc, &block )
+      score_items( content_node, budget ) do |node|
+        dot( content_node.search_norm, node.search_norm )
+      end
+    end
+
+    # Indexes marshaled before items had handles keep them in a Hash of item
+    # => node; they are given handles the first time they are used. Those
+    # marshaled before there was a vocabulary also key their words by Symbol,
+    # and are given a vocabulary of those words. The word list keeps its
+    # dimensions, so the vectors already built stay valid.
+    def upgrade_items
+      return if @handles
+      items = @items || {}
+      unless @vocabulary
+        @vocabulary = Vocabulary.new
+        @word_list = @word_list ? @word_list.upgrade( @vocabulary ) : WordList.new( @vocabulary )
+        items.each_value { |node| node.upgrade( @vocabulary ) }
+      end
+      @handles, @nodes, @item_for = {}, {}, {}
+      items.each_with_index do |(item, node), handle|
+        @handles[item], @nodes[handle], @item_for[handle] = handle, node, item
+      end
+      @next_handle = items.size
+      @retain_items, @snapshots, @clusters = true, [], nil
+      remove_instance_variable :@items if defined?(@items)
+    end
+
+    def build_reduced_matrix( matrix, cutoff=0.75, pause=nil )
       # TODO: Check that M>=N on these dimensions! Transpose helps assure this
-      u, v, s = matrix.SV_decomp
+      u, v, s = matrix.SV_decomp(&pause)
+      pause.call if pause
+      # The pure Ruby SVD hands back the document side first when there are
+      # more documents than terms.
+      u, v = v, u if ($GSL ? u.size1 : u.row_size) != ($GSL ? matrix.size1 : matrix.row_size)
 
       # TODO: Better than 75% term, please. :\
       s_cutoff = s.sort.reverse[(s.size * cutoff).round - 1]
@@ -288,16 +580,99 @@ module Classifier
         s[ord] = 0.0 if s[ord] < s_cutoff
       end
       # Reconstruct the term document matrix, only with reduced rank
-      u * ($GSL ? GSL::Matrix : ::Matrix).diag( s ) * v.trans
+      return u * ($GSL ? GSL::Matrix : ::Matrix).diag( s ) * v.trans, TermVectors.new( u, s )
+    end
+
+    # Groups the items around roughly sqrt(n) centroids, so that budgeted
+    # queries can visit the most promising part of the index first. Seeds are
+    # spread evenly through the items, and each item joins the seed nearest to
+    # it; the centroid is the normalized mean of its members.
+    def build_clusters( handles, doc_list, slice=nil, pause=nil )
+      return [] if doc_list.empty?
+      k = Math.sqrt(doc_list.size).ceil
+      seeds = (0...k).collect { |i| doc_list[(i * doc_list.size).div(k)].lsi_norm }
+      members = Array.new(k) { [] }
+      each_in_slices( (0...doc_list.size).to_a, slice, pause ) do |i|
+        nearest = (0...k).max_by { |c| dot( seeds[c], doc_list[i].lsi_norm ) }
+        members[nearest] << i
+      end
+      members.reject { |m| m.empty? }.collect do |m|
+        sum = m.collect { |i| doc_list[i].lsi_norm }.inject { |a, b| a + b }
+        [normalize( sum ), m.collect { |i| handles[i] }]
+      end
+    end
+
+    # Yields the node of each indexed item to compute its score, returning
+    # [handle, score] pairs from best to worst. With a budget, clusters are
+    # visited nearest first and scoring stops once the budget runs out.
+    def score_items( content_node, budget )
+      order = budget && @clusters ? items_by_cluster( content_node.search_norm ) : @handles.values
+      result = []
+      order.each do |handle|
+        break if budget && budget.exhausted?
+        node = @nodes[handle]
+        next unless node
+        result << [handle, yield(node)]
+        budget.spend if budget
+      end
+      result.sort_by { |x| x[1] }.reverse
+    end
+
+    def items_by_cluster( norm )
+      clusters = @clusters.sort_by { |centroid, members| -dot( norm, centroid ) }
+      clusters.inject([]) { |order, (centroid, members)| order.concat(members) }
+    end
+
+    # Returns the indices of the count largest values, largest first, leaving
+    # out skip. Only a sorted list of the best count is kept, which is far
+    # cheaper than sorting all the values when count is small.
+    def top_indices( values, count, skip=nil )
+      best = []
+      values.each_with_index do |x, i|
+        next if i == skip
+        next if best.size >= count && x <= values[best.last]
+        at = best.index { |j| x > values[j] } || best.size
+        best.insert(at, i)
+        best.pop if best.size > count
+      end
+      best
+    end
+
+    def dot( a, b )
+      $GSL ? a * b.col : a.inner_product(b)
+    end
+
+    # Normalizes vec, leaving it untouched if it is all zeros.
+    def normalize( vec )
+      vec.to_a.any? { |x| x != 0 } ? vec.normalize : vec
+    end
+
+    # Yields each element of list, calling pause after every slice of them.
+    def each_in_slices( list, slice, pause )
+      list.each_with_index do |x, i|
+        pause.call if pause && i > 0 && i % slice == 0
+        yield x
+      end
+    end
+
+    def yield_to_scheduler
+      if defined?(Fiber.scheduler) && Fiber.scheduler
+        sleep 0
+      else
+        Thread.pass
+      end
     end
 
-    def node_for_content(item, &block)
-      if @items[item]
-        return @items[item]
+    def node_for_content(item, handle=handle_for( item ), &block)
+      node = handle && @nodes[handle]
+      if node
+        return node
       else
-        clean_word_hash = block ? block.call(item).clean_word_hash : item.to_s.clean_word_hash
+        # Words the index has never seen cannot contribute to the vector, so
+        # there is no need to grow the vocabulary with them.
+        word_ids = block ? block.call(item).clean_word_ids(@vocabulary, false) : item.to_s.clean_word_ids(@vocabulary, false)
 
-        cn = ContentNode.new(clean_word_hash, &block) # make the node and extract the data
+        cn = ContentNode.new(word_ids, &block) # make the node and extract the data
 
         unless needs_rebuild?
           cn.raw_vector_with( @word_list ) # make the lsi raw and norm vectors
@@ -307,11 +682,12 @@ module Classifier
       return cn
     end
 
-    def make_word_list
-      @word_list = WordList.new
-      @items.each_value do |node|
-        node.word_hash.each_key { |key| @word_list.add_word key }
+    def make_word_list( doc_list, slice=nil, pause=nil )
+      word_list = WordList.new(@vocabulary)
+      each_in_slices( doc_list, slice, pause ) do |node|
+        node.word_hash.each_key { |key| word_list.add_word key }
       end
+      word_list
     end
 
   end
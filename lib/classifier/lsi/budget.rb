@@ -0,0 +1,59 @@
+# License::   LGPL
+
+module Classifier
+  class LSI
+    # A Budget bounds the work done by a single LSI query: search,
+    # find_related, classify and the proximity functions all accept one as an
+    # optional argument. Once the budget runs out, the query stops scoring
+    # items and answers from the best ones found so far.
+    #
+    # Budgeted queries visit the index cluster by cluster, starting with the
+    # clusters whose centroids are closest to the query, so the best matches
+    # are usually among the first items scored.
+    #
+    # For example, to spend at most 50 ms or 1000 items on a search:
+    #   budget = Classifier::LSI::Budget.new :time => 0.05, :items => 1000
+    #   lsi.search "dog", 3, budget
+    #   budget.partial?  # => true if the search had to stop early
+    class Budget
+      attr_reader :time, :items, :scored
+
+      # :time is the wall clock allowance in seconds, and :items the number
+      # of indexed items that may be scored. Either may be omitted.
+      def initialize( options = {} )
+        @time, @items = options[:time], options[:items]
+        start
+      end
+
+      # Restarts the clock and the item count. Queries call this themselves,
+      # so one budget may be reused for several queries in turn.
+      def start
+        @deadline = @time && now + @time
+        @scored, @partial = 0, false
+        self
+      end
+
+      # Records that one more item has been scored.
+      def spend
+        @scored += 1
+      end
+
+      # Returns true, and marks the result as partial, once either limit has
+      # been reached.
+      def exhausted?
+        @partial ||= (@items && @scored >= @items) || (@deadline && now >= @deadline) || false
+      end
+
+      # Returns true if the last query stopped before scoring every item.
+      def partial?
+        @partial
+      end
+
+      private
+
+      def now
+        Process.clock_gettime(Process::CLOCK_MONOTONIC)
+      end
+    end
+  end
+end
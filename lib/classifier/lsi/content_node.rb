@@ -13,13 +13,20 @@ module Classifier
                   :categories
 
     attr_reader :word_hash
-    # If text_proc is not specified, the source will be duck-typed
-    # via source.to_s
+    # word_hash maps the vocabulary id of each stemmed word to its frequency,
+    # as returned by String#clean_word_ids.
     def initialize( word_hash, *categories )
       @categories = categories || []
       @word_hash = word_hash
     end
 
+    # Copies have categories of their own, since those of a published node
+    # are frozen.
+    def initialize_copy( other )
+      super
+      @categories = @categories.dup
+    end
+
     # Use this to fetch the appropriate search vector.
     def search_vector
       @lsi_vector || @raw_vector
@@ -30,6 +37,28 @@ module Classifier
       @lsi_norm || @raw_norm
     end
 
+    # Nodes marshal with their word counts and vectors packed as binary
+    # Strings, rather than as one object per number. The normalized vectors
+    # are recomputed on load instead of being stored.
+    def marshal_dump
+      [@categories, Packed.pack_counts(@word_hash),
+       Packed.pack_floats(@raw_vector), Packed.pack_floats(@lsi_vector)]
+    end
+
+    def marshal_load( data )
+      @categories, word_hash, raw_vector, lsi_vector = data
+      @word_hash = Packed.unpack_counts(word_hash)
+      @raw_vector, @lsi_vector = Packed.unpack_vector(raw_vector), Packed.unpack_vector(lsi_vector)
+      @raw_norm = normalize(@raw_vector) if @raw_vector
+      @lsi_norm = normalize(@lsi_vector) if @lsi_vector
+    end
+
+    # Nodes marshaled before there was a vocabulary count their words by
+    # Symbol. This keys them by their ids in +vocabulary+ instead.
+    def upgrade( vocabulary )
+      @word_hash = vocabulary.ids_for( @word_hash )
+    end
+
     # Creates the raw vector out of word_hash using word_list as the
     # key for mapping the vector space.
     def raw_vector_with( word_list )
@@ -55,18 +84,28 @@ module Classifier
             weighted_total += (( term / total_words ) * Math.log( term / total_words ))
           end
         end
-        vec = vec.collect { |val| Math.log( val + 1 ) / -weighted_total }
+        # A single repeated word carries no entropy to weight by.
+        vec = vec.collect { |val| Math.log( val + 1 ) / -weighted_total } if weighted_total < 0
       end
 
+      # Content sharing no words with the index has no direction, so its
+      # zero vector is kept as is rather than normalized into NaNs.
       if $GSL
-         @raw_norm   = vec.normalize
+         @raw_norm   = total_words > 0 ? vec.normalize : vec
          @raw_vector = vec
       else
-         @raw_norm   = Vector[*vec].normalize
+         @raw_norm   = total_words > 0 ? Vector[*vec].normalize : Vector[*vec]
          @raw_vector = Vector[*vec]
       end
     end
 
+    private
+
+    # Normalizes vec, leaving it untouched if it is all zeros.
+    def normalize( vec )
+      vec.to_a.any? { |x| x != 0 } ? vec.normalize : vec
+    end
+
   end
 
 end
@@ -0,0 +1,53 @@
+# License::   LGPL
+
+module Classifier
+
+# This is an internal data structure class for LSI#related_terms. It holds
+# the rows of U_k * S_k from the index's SVD, one per word list dimension,
+# normalized and stored contiguously in a single flat Array, so that the
+# similarity of one term to all others is one pass over memory.
+  class TermVectors
+    attr_reader :size, :rank
+
+    # u is the term side of the decomposition and s its singular values,
+    # with those discarded by the cutoff already set to zero.
+    def initialize( u, s )
+      dims = (0...s.size).select { |j| s[j] > 0 }
+      @size = $GSL ? u.size1 : u.row_size
+      @rank = dims.size
+      @values = Array.new(@size * @rank, 0.0)
+      @size.times do |i|
+        row = dims.collect { |j| u[i,j] * s[j] }
+        mag = Math.sqrt(row.inject(0.0) { |sum, x| sum + x * x })
+        next if mag == 0
+        row.each_with_index { |x, c| @values[i * @rank + c] = x / mag }
+      end
+    end
+
+    # Returns the cosine similarity of row dim with every row, in dimension
+    # order. GSL does this as a single matrix-vector product.
+    def similarities( dim )
+      if $GSL
+        @matrix ||= GSL::Matrix.alloc(@values, @size, @rank)
+        (@matrix * @matrix.row(dim).col).to_a
+      else
+        base = dim * @rank
+        Array.new(@size) do |i|
+          offset, sim = i * @rank, 0.0
+          @rank.times { |c| sim += @values[offset + c] * @values[base + c] }
+          sim
+        end
+      end
+    end
+
+    def marshal_dump
+      [@size, @rank, @values.pack('E*')]
+    end
+
+    def marshal_load( data )
+      @size, @rank, values = data
+      @values = values.unpack('E*')
+    end
+  end
+
+end
@@ -3,28 +3,39 @@
 # License::   LGPL
 
 module Classifier
-  # This class keeps a word => index mapping. It is used to map stemmed words
-  # to dimensions of a vector.
+  # This class keeps a word id => index mapping. It is used to map the
+  # vocabulary ids of stemmed words to dimensions of a vector.
 
   class WordList
-    def initialize
+    attr_reader :vocabulary
+
+    def initialize(vocabulary = Vocabulary.new)
+      @vocabulary = vocabulary
       @location_table = Hash.new
+      @ids = []
     end
 
-    # Adds a word (if it is new) and assigns it a unique dimension.
-    def add_word(word)
-      term = word
-      @location_table[term] = @location_table.size unless @location_table[term]
+    # Adds a word id (if it is new) and assigns it a unique dimension.
+    def add_word(id)
+      unless @location_table[id]
+        @location_table[id] = @ids.size
+        @ids << id
+      end
     end
 
-    # Returns the dimension of the word or nil if the word is not in the space.
+    # Returns the dimension of the word id or nil if the word is not in the space.
     def [](lookup)
-      term = lookup
-      @location_table[term]
+      @location_table[lookup]
+    end
+
+    # Returns the vocabulary id of the word at dimension ind.
+    def id_for_index(ind)
+      @ids[ind]
     end
 
+    # Returns the word at dimension ind.
     def word_for_index(ind)
-      @location_table.invert[ind]
+      @vocabulary.word_for(@ids[ind])
     end
 
     # Returns the number of words mapped.
@@ -32,5 +43,27 @@ module Classifier
       @location_table.size
     end
 
+    # Word lists marshaled before there was a vocabulary map Symbols to
+    # dimensions. This maps the ids of those words in +vocabulary+ instead,
+    # each to the dimension it had.
+    def upgrade(vocabulary)
+      return self if @vocabulary
+      words = @location_table.keys.sort_by { |word| @location_table[word] }
+      @vocabulary, @location_table, @ids = vocabulary, Hash.new, []
+      words.each { |word| add_word vocabulary.add(word) }
+      self
+    end
+
+    def marshal_dump
+      format = Packed.int_format(@ids)
+      [@vocabulary, format, @ids.pack(format)]
+    end
+
+    def marshal_load(data)
+      @vocabulary, format, ids = data
+      @location_table, @ids = Hash.new, []
+      ids.unpack(format).each { |id| add_word id }
+    end
+
   end
 end
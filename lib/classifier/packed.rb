@@ -0,0 +1,77 @@
+# License::   LGPL
+
+module Classifier
+  # Helpers for the compact Marshal formats of LSI, its parts and
+  # Vocabulary.
+  # Rather than letting Marshal write every count and every Float as an
+  # object of its own, numeric data is packed into binary Strings, which are
+  # both much smaller and much faster to dump and load.
+  module Packed
+    module_function
+
+    # Packs a Hash of Integer id => count. Ids and Integer counts are stored
+    # in the narrowest fixed width that holds them all, and anything else as
+    # doubles.
+    def pack_counts(hash)
+      keys, values = hash.keys, hash.values
+      key_format = int_format(keys)
+      format = values.all?(Integer) ? int_format(values) : 'E*'
+      [key_format, keys.pack(key_format), format, values.pack(format)]
+    end
+
+    def unpack_counts(data)
+      key_format, keys, format, values = data
+      keys.unpack(key_format).zip(values.unpack(format)).to_h
+    end
+
+    # Returns the pack format of the narrowest integer type that holds every
+    # Integer in +ints+.
+    def int_format(ints)
+      min, max = ints.minmax
+      return 'q<*' if min.nil? || min < 0 || max >= 2**32
+      max < 2**8 ? 'C*' : (max < 2**16 ? 'S<*' : 'L<*')
+    end
+
+    # Packs a GSL::Vector, Vector or Array of numbers, or leaves nil as it
+    # is. Term vectors are mostly zeros, so only the positions and values
+    # (as doubles) of the non-zero entries are kept.
+    def pack_floats(vector)
+      return nil unless vector
+      values = vector.to_a
+      nonzero = (0...values.size).select { |i| values[i] != 0 }
+      format = int_format(nonzero)
+      [values.size, format, nonzero.pack(format), values.values_at(*nonzero).pack('E*')]
+    end
+
+    # Unpacks a vector packed by pack_floats into the vector type in use,
+    # GSL::Vector or Vector.
+    def unpack_vector(data)
+      return nil unless data
+      size, format, nonzero, values = data
+      floats = Array.new(size, 0.0)
+      nonzero.unpack(format).zip(values.unpack('E*')) { |i, x| floats[i] = x }
+      $GSL ? GSL::Vector.alloc(floats) : ::Vector.elements(floats, false)
+    end
+
+    # Packs an Array of Strings as one joined String and their byte lengths.
+    def pack_strings(strings)
+      joined = String.new(capacity: strings.inject(0) { |sum, s| sum + s.bytesize })
+      strings.each { |s| joined << s.b }
+      lengths = strings.collect { |s| s.bytesize }
+      format = int_format(lengths)
+      [joined, format, lengths.pack(format)]
+    end
+
+    # Unpacks Strings packed by pack_strings, as frozen UTF-8 Strings.
+    def unpack_strings(data)
+      joined, format, lengths = data
+      joined = joined.dup.force_encoding(Encoding::UTF_8)
+      offset = 0
+      lengths.unpack(format).collect do |length|
+        s = joined.byteslice(offset, length).freeze
+        offset += length
+        s
+      end
+    end
+  end
+end
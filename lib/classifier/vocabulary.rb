@@ -0,0 +1,153 @@
+# License::   LGPL
+
+require 'classifier/vocabulary/compact'
+
+module Classifier
+  # A Vocabulary assigns every distinct token a small integer id, and maps
+  # those ids back to their tokens. The tokenizer can emit ids straight into
+  # a vocabulary (see String#word_ids), so Bayes and LSI can store and look up
+  # Integers instead of interning a Symbol for every token they see.
+  #
+  # A single vocabulary may be shared by several classifiers:
+  #   vocab = Classifier::Vocabulary.new
+  #   b     = Classifier::Bayes.new 'Interesting', 'Uninteresting', :vocabulary => vocab
+  #   lsi   = Classifier::LSI.new :vocabulary => vocab
+  #
+  # Once a vocabulary is frozen, unknown tokens are no longer added; they
+  # simply have no id, which keeps a production model from growing. A
+  # vocabulary that will not grow again can also be compacted (see
+  # #compact!), which freezes it and shrinks it severalfold.
+  class Vocabulary
+    include Enumerable
+
+    def initialize(words = [])
+      @ids, @words = {}, []
+      @lock = Mutex.new
+      @frozen = false
+      words.each { |word| add word }
+    end
+
+    # Returns the id of +word+, assigning it the next free id if it is new.
+    # A frozen vocabulary returns nil for words it does not already know.
+    #
+    # Until it is frozen, a vocabulary is read and written under a lock, so
+    # that threads tokenizing into a shared vocabulary never give out the
+    # same id twice, nor read its tables while another thread is adding to
+    # them. A frozen vocabulary no longer changes, and is read without one.
+    def add(word)
+      word = word.to_s
+      return self[word] if frozen?
+      @lock.synchronize do
+        @ids[word] || begin
+          word = word.dup.freeze
+          @words << word
+          @ids[word] = @words.size - 1
+        end
+      end
+    end
+
+    # Maps pre-tokenized term counts (a Hash, or an Array of term/count
+    # pairs) onto ids, returning a Hash of id => count like String#word_ids.
+    # Integer terms are taken to be ids already (see #id_for). Unknown terms
+    # are added unless +grow+ is false or the vocabulary is frozen.
+    def ids_for(counts, grow = true)
+      ids = Hash.new(0)
+      counts.each do |term, count|
+        id = id_for(term, grow)
+        ids[id] += count if id
+      end
+      ids
+    end
+
+    # Returns the id of a single pre-tokenized term, as #ids_for maps it.
+    # An Integer term must be an id this vocabulary has given out, since
+    # any other would be counted against no token at all; it raises an
+    # ArgumentError otherwise.
+    def id_for(term, grow = true)
+      return grow ? add(term) : self[term] unless term.is_a?(Integer)
+      raise ArgumentError, "No such token id: #{term}" unless term >= 0 && term < size
+      term
+    end
+
+    # Returns the id of +word+ (a String or Symbol), or nil if it is unknown.
+    def [](word)
+      return @compact.id(word.to_s) if @compact
+      frozen? ? @ids[word.to_s] : @lock.synchronize { @ids[word.to_s] }
+    end
+
+    # Returns the token with the given id.
+    def word_for(id)
+      return @compact.word(id) if @compact
+      frozen? ? @words[id] : @lock.synchronize { @words[id] }
+    end
+
+    def include?(word)
+      !self[word].nil?
+    end
+
+    # Returns the number of tokens known.
+    def size
+      @compact ? @compact.size : @words.size
+    end
+
+    # Yields every token and its id, in id order.
+    def each
+      size.times { |id| yield word_for(id), id }
+    end
+
+    # Replaces the token table with a Vocabulary::Compact, keeping every id,
+    # and freezes the vocabulary. A frozen vocabulary can be compacted too.
+    # Every classifier sharing this vocabulary benefits at once, from a
+    # table a fraction of the size; in return, a lookup is about 20 times
+    # slower than in the Hash it replaces (some 3 microseconds rather than
+    # 0.15, for 100_000 tokens).
+    def compact!
+      @compact ||= Compact.new(@words)
+      @ids = @words = nil
+      freeze
+    end
+
+    def compact?
+      !@compact.nil?
+    end
+
+    # Stops the vocabulary from growing. Only its token tables are frozen,
+    # not the vocabulary object itself, so that it can still be compacted.
+    def freeze
+      @ids.freeze if @ids
+      @words.freeze if @words
+      @frozen = true
+      self
+    end
+
+    def frozen?
+      @frozen
+    end
+
+    # Vocabularies marshal as one joined String of their tokens, or as their
+    # compact table.
+    def marshal_dump
+      @compact ? [nil, true, @compact] : [Packed.pack_strings(@words), frozen?]
+    end
+
+    def marshal_load(data)
+      words, frozen, @compact = data
+      @lock, @frozen = Mutex.new, false
+      unless @compact
+        @ids, @words = {}, Packed.unpack_strings(words)
+        @words.each_with_index { |word, id| @ids[word] = id }
+      end
+      freeze if frozen
+    end
+
+    # Writes the vocabulary to +path+, one token per line in id order.
+    def save(path)
+      File.open(path, "w") { |f| each { |word, id| f.puts word } }
+    end
+
+    # Reads a vocabulary written by #save. Ids are preserved.
+    def self.load(path)
+      new(File.read(path).split("\n"))
+    end
+  end
+end
@@ -0,0 +1,155 @@
+# License::   LGPL
+
+require 'zlib'
+
+module Classifier
+  class Vocabulary
+    # The storage of a compacted Vocabulary (see Vocabulary#compact!). It
+    # holds the same tokens with the same ids in a handful of binary Strings,
+    # instead of a String object, a Hash entry and an Array slot per token:
+    #
+    # * The tokens are sorted and front coded in blocks of BLOCK: the first
+    #   token of a block is stored whole, and each following one as the
+    #   length of the prefix it shares with the one before, plus the rest.
+    # * A minimal perfect hash maps each token to a slot of its own, which
+    #   holds the token's position in sorted order. The hash is built the CHD
+    #   way: tokens are spread over buckets, and each bucket is given the
+    #   first seed that sends its tokens to free slots; buckets of a single
+    #   token just record the slot they take. A bucket that no seed up to
+    #   SEEDS can place (tokens that hash alike under every seed) is kept
+    #   in a small overflow Hash instead, marked by a seed of 0.
+    #
+    # A lookup hashes the token twice, reads two integers and decodes one
+    # block to check that the token really is the one in that slot.
+    class Compact
+      BLOCK = 8
+      SEEDS = 1 << 16
+
+      attr_reader :size
+
+      # words is the Array of tokens, indexed by id.
+      def initialize(words)
+        @size = words.size
+        ranks = (0...@size).sort_by { |id| words[id].b }
+        @id_by_rank = ranks.pack('L<*')
+        rank_by_id = Array.new(@size)
+        ranks.each_with_index { |id, rank| rank_by_id[id] = rank }
+        @rank_by_id = rank_by_id.pack('L<*')
+        front_code ranks.collect { |id| words[id].b }
+        build_hash words, rank_by_id
+      end
+
+      # Returns the id of word, or nil.
+      def id(word)
+        return nil if @size == 0
+        word = word.b
+        seed = @seeds.unpack1('l<', :offset => 4 * (Zlib.crc32(word) % @buckets))
+        if seed == 0
+          rank = @overflow[word]
+          return nil unless rank
+        else
+          slot = seed < 0 ? -seed - 1 : Compact.slot(word, seed, @size)
+          rank = @ranks.unpack1('L<', :offset => 4 * slot)
+          return nil unless rank < @size && token(rank) == word
+        end
+        @id_by_rank.unpack1('L<', :offset => 4 * rank)
+      end
+
+      # Returns the token with the given id, or nil.
+      def word(id)
+        return nil unless id >= 0 && id < @size
+        token(@rank_by_id.unpack1('L<', :offset => 4 * id)).force_encoding(Encoding::UTF_8).freeze
+      end
+
+      # Returns the number of bytes of packed storage.
+      def bytesize
+        [@id_by_rank, @rank_by_id, @blocks, @offsets, @seeds, @ranks].inject(0) { |sum, s| sum + s.bytesize }
+      end
+
+      # A multiply-xorshift step. CRC32 is linear, so it is mixed before
+      # being reduced to a slot; otherwise two tokens of the same length that
+      # collide under one seed could collide under every seed.
+      def self.mix(h)
+        h = (h * 0x9E3779B1) & 0xFFFFFFFF
+        h ^ (h >> 16)
+      end
+
+      # The slot of +word+ (a binary String) under +seed+. Tokens of the
+      # same length and CRC32 share their seeded CRC32 for every seed, so
+      # a seeded Adler-32 is mixed in to tell them apart.
+      def self.slot(word, seed, size)
+        mix(Zlib.crc32(word, seed) ^ mix(Zlib.adler32(word, seed))) % size
+      end
+
+      private
+
+      def front_code(sorted)
+        blocks, offsets, previous = "".b, [], nil
+        sorted.each_with_index do |token, rank|
+          if rank % BLOCK == 0
+            offsets << blocks.bytesize
+            previous = "".b
+          end
+          prefix = 0
+          limit = [previous.bytesize, token.bytesize, 255].min
+          prefix += 1 while prefix < limit && previous.getbyte(prefix) == token.getbyte(prefix)
+          suffix = token.byteslice(prefix, token.bytesize - prefix)
+          # Suffix lengths from 255 up are spelled out in four bytes.
+          blocks << (suffix.bytesize < 255 ? [prefix, suffix.bytesize].pack('CC') : [prefix, 255, suffix.bytesize].pack('CCL<'))
+          blocks << suffix
+          previous = token
+        end
+        @blocks, @offsets = blocks, offsets.pack('L<*')
+      end
+
+      def token(rank)
+        offset = @offsets.unpack1('L<', :offset => 4 * rank.div(BLOCK))
+        token = "".b
+        (rank % BLOCK + 1).times do
+          prefix, length = @blocks.unpack('CC', :offset => offset)
+          offset += 2
+          if length == 255
+            length = @blocks.unpack1('L<', :offset => offset)
+            offset += 4
+          end
+          token = token.byteslice(0, prefix) << @blocks.byteslice(offset, length)
+          offset += length
+        end
+        token
+      end
+
+      def build_hash(words, rank_by_id)
+        @buckets = [(@size + 1).div(2), 1].max
+        buckets = Array.new(@buckets) { [] }
+        words.each_with_index { |word, id| buckets[Zlib.crc32(word.b) % @buckets] << id }
+        seeds, slots = Array.new(@buckets, 0), Array.new(@size)
+        @overflow = Hash.new
+        free = (0...@size).to_a.reverse
+        order = (0...@buckets).sort_by { |b| -buckets[b].size }
+        order.each do |b|
+          ids = buckets[b]
+          break if ids.empty?
+          if ids.size == 1
+            free.pop while slots[free.last]
+            slot = free.pop
+            seeds[b] = -slot - 1
+            slots[slot] = rank_by_id[ids[0]]
+            next
+          end
+          seed = (1..SEEDS).find do |candidate|
+            chosen = ids.collect { |id| Compact.slot(words[id].b, candidate, @size) }
+            chosen.uniq.size == chosen.size && chosen.none? { |slot| slots[slot] }
+          end
+          if seed
+            seeds[b] = seed
+            ids.each { |id| slots[Compact.slot(words[id].b, seed, @size)] = rank_by_id[id] }
+          else
+            ids.each { |id| @overflow[words[id].b] = rank_by_id[id] }
+          end
+        end
+        # Slots left over by overflowing buckets hold an impossible rank.
+        @seeds, @ranks = seeds.pack('l<*'), slots.collect { |rank| rank || 0xFFFFFFFF }.pack('L<*')
+      end
+    end
+  end
+end
@@ -27,4 +27,199 @@ class BayesianTest < Minitest::Test
 		@classifier.train_uninteresting "here are some bad words, I hate you"
 		assert_equal 'Uninteresting', @classifier.classify("I hate bad words and you")
 	end
+
+	def test_serialize_safe
+		@classifier.train_interesting "here are some good words. I hope you love them"
+		@classifier.train_uninteresting "here are some bad words, I hate you"
+		loaded = Marshal.load(Marshal.dump(@classifier))
+		assert_equal @classifier.classifications("I hate bad words and you"), loaded.classifications("I hate bad words and you")
+		loaded.train_interesting "more good words"
+		assert_equal ['Interesting', 'Uninteresting'].sort, loaded.categories.sort
+	end
+
+	def test_load_baseline_dump
+		# Marshaled by the classifier as it was before it had a vocabulary, with
+		# the two trainings of test_serialize_safe.
+		loaded = Marshal.load(File.binread(File.dirname(__FILE__) + '/baseline_bayes.dump'))
+		@classifier.train_interesting "here are some good words. I hope you love them"
+		@classifier.train_uninteresting "here are some bad words, I hate you"
+		expected = @classifier.classifications("I hate bad words and you")
+		loaded.classifications("I hate bad words and you").each { |category, score| assert_in_delta expected[category], score, 1e-9 }
+		assert_equal @classifier.vocabulary.size, loaded.vocabulary.size
+		[@classifier, loaded].each { |b| b.train_interesting "more good words" }
+		reloaded = Marshal.load(Marshal.dump(loaded))
+		expected = @classifier.classifications("good words you love")
+		reloaded.classifications("good words you love").each { |category, score| assert_in_delta expected[category], score, 1e-9 }
+	end
+
+	def test_untrain_releases_counts
+		@classifier.train_interesting "here are some good words. I hope you love them"
+		@classifier.untrain_interesting "here are some good words. I hope you love them"
+		@classifier.untrain_interesting "words never trained at all"
+		assert_equal 0, @classifier.instance_variable_get(:@total_words)
+		assert @classifier.instance_variable_get(:@categories).values.all? { |words| words.empty? }
+		assert @classifier.instance_variable_get(:@category_counts).empty?
+	end
+
+	def test_postings_follow_untraining
+		@classifier.train_interesting "here are some good words. I hope you love them"
+		@classifier.train_uninteresting "here are some bad words, I hate you"
+		@classifier.train_uninteresting "love love love"
+		@classifier.untrain_uninteresting "love love love"
+		rebuilt = Marshal.load(Marshal.dump(@classifier))
+		assert_equal rebuilt.classifications("I love bad words"), @classifier.classifications("I love bad words")
+		assert_equal rebuilt.send(:postings), @classifier.send(:postings)
+	end
+
+	def test_compiled_score_table
+		@classifier.add_category 'Spam'
+		@classifier.train_interesting "here are some good words. I hope you love them"
+		@classifier.train_uninteresting "here are some bad words, I hate you"
+		@classifier.train_spam "buy cheap words now"
+		table = @classifier.compile
+		["I hate bad words and you", "cheap love", "", "never seen before"].each do |text|
+			expected = @classifier.classifications(text)
+			table.classifications(text).each { |category, score| assert_in_delta expected[category], score, 1e-9 }
+			assert_equal @classifier.classify(text), table.classify(text) unless text.empty?
+		end
+		ranked = @classifier.classifications("I hate bad words and you").sort_by { |category, score| -score }
+		assert_equal ranked[0, 2].collect { |category, score| category }, table.top("I hate bad words and you", 2)
+	end
+
+	def test_quantized_score_table
+		@classifier.add_category 'Spam'
+		@classifier.train_interesting "here are some good words. I hope you love them"
+		@classifier.train_uninteresting "here are some bad words, I hate you"
+		@classifier.train_spam "buy cheap words now, cheap cheap cheap"
+		texts = ["I hate bad words and you", "cheap love", "buy now", "never seen before"]
+		[16, 8].each do |bits|
+			table = @classifier.compile :bits => bits
+			assert_equal bits, table.bits
+			texts.each do |text|
+				expected = @classifier.classifications(text)
+				table.classifications(text).each do |category, score|
+					assert_in_delta expected[category], score, 4 * table.max_weight_error
+				end
+			end
+			report = table.deviation(@classifier, texts)
+			assert report[:max_error] <= 4 * table.max_weight_error
+			assert_equal 1.0, report[:agreement]
+		end
+		assert_raises(ArgumentError) { @classifier.compile :bits => 4 }
+	end
+
+	def test_select_features
+		[:chi2, :mutual_info].each do |method|
+			b = Classifier::Bayes.new 'Interesting', 'Uninteresting'
+			b.train_interesting "lovely lovely lovely words words words"
+			b.train_uninteresting "hateful hateful hateful words words words"
+			b.train_interesting "lovely sunshine"
+			before = b.classifications "lovely hateful"
+			b.select_features! 2, :method => method
+			after = b.classifications "lovely hateful"
+			before.each { |category, score| assert_in_delta score, after[category], 1e-9 }
+			assert_equal 'Interesting', b.classify("lovely")
+			assert_equal 'Uninteresting', b.classify("hateful")
+			counts = b.instance_variable_get(:@categories)
+			assert_equal [[b.vocabulary['love']], [b.vocabulary['hate']]], counts.values.collect(&:keys)
+		end
+		assert_raises(ArgumentError) { @classifier.select_features! 10, :method => :entropy }
+	end
+
+	def test_training_buffer
+		buffered = Classifier::Bayes.new 'Interesting', 'Uninteresting', :vocabulary => @classifier.vocabulary
+		buffer = Classifier::Bayes::TrainingBuffer.new buffered, :tokens => 12
+		texts = [[:interesting, "here are some good words. I hope you love them"],
+		         [:uninteresting, "here are some bad words, I hate you"],
+		         [:uninteresting, "bad bad words"], [:interesting, "good words"]]
+		texts.each { |category, text| @classifier.train category, text }
+		texts.each { |category, text| buffer.train category, text }
+		assert buffer.pending > 0
+		assert buffer.pending < 12
+		buffer.flush
+		assert_equal 0, buffer.pending
+		assert_equal @classifier.classifications("I hate bad words and you"), buffered.classifications("I hate bad words and you")
+		assert_equal @classifier.instance_variable_get(:@total_words), buffered.instance_variable_get(:@total_words)
+	end
+
+	def test_training_buffer_failures
+		buffer = Classifier::Bayes::TrainingBuffer.new @classifier
+		assert_raises(StandardError) { buffer.train :unknown, "some words" }
+		assert_equal 0, buffer.pending
+
+		buffer.train :interesting, "good words"
+		buffer.train :uninteresting, "bad words"
+		failing = true
+		original = @classifier.method(:merge_ids)
+		@classifier.define_singleton_method(:merge_ids) do |category, ids, documents|
+			raise IOError, "disk full" if failing && category == :Uninteresting
+			original.call(category, ids, documents)
+		end
+		assert_raises(IOError) { buffer.flush }
+		failing = false
+		buffer.flush
+		assert_equal 0, buffer.pending
+		assert_equal 4, @classifier.instance_variable_get(:@total_words)
+	end
+
+	def test_failed_merge_leaves_category_unchanged
+		@classifier.train :interesting, "good words"
+		@classifier.classify "good words"
+		state = lambda { Marshal.load(Marshal.dump(%w(@categories @postings @totals @category_counts @total_words).collect { |name| @classifier.instance_variable_get(name) })) }
+		before = state.call
+		good, words = @classifier.vocabulary["good"], @classifier.vocabulary["word"]
+		assert_raises(TypeError) { @classifier.merge_ids :interesting, [[good, 2], [99, 1], [words, "x"]], 1 }
+		assert_equal before, state.call
+	end
+
+	def test_concurrent_trainer
+		texts = Array.new(40) { |i| [i.even? ? :interesting : :uninteresting, "text number #{i} with words#{i % 7} and more#{i % 3}"] }
+		texts.each { |category, text| @classifier.train category, text }
+		concurrent = Classifier::Bayes.new 'Interesting', 'Uninteresting'
+		trainer = Classifier::Bayes::ConcurrentTrainer.new concurrent, :tokens => 5
+		threads = Array.new(4) do |t|
+			Thread.new { texts.each_with_index { |(category, text), i| trainer.train category, text if i % 4 == t } }
+		end
+		threads.each(&:join)
+		trainer.flush
+		assert_equal 0, trainer.pending
+		assert_equal @classifier.vocabulary.size, concurrent.vocabulary.size
+		["text number 3", "words5 more2", "nothing known"].each do |text|
+			expected = @classifier.classifications(text)
+			trainer.classifications(text).each { |category, score| assert_in_delta expected[category], score, 1e-9 }
+		end
+	end
+
+	def test_session
+		@classifier.add_category 'Spam'
+		@classifier.train_interesting "here are some good words. I hope you love them"
+		@classifier.train_uninteresting "here are some bad words, I hate you"
+		@classifier.train_spam "buy cheap words now"
+		text = "I hate bad words and you, buy now!"
+		[@classifier.session(:margin => 1000), @classifier.compile.session(:margin => 1000)].each do |session|
+			text.scan(/.{1,4}/m).each { |chunk| session << chunk }
+			assert !session.decided?
+			session.finish
+			expected = @classifier.classifications(text)
+			session.classifications.each { |category, score| assert_in_delta expected[category], score, 1e-9 }
+			assert_equal @classifier.classify(text), session.classify
+		end
+		session = @classifier.session :margin => 1.0
+		assert_nil session.feed("I ")
+		assert_equal 'Uninteresting', session.feed("hate bad words and ")
+		assert session.decided?
+		session << "buy cheap now cheap buy "
+		assert_equal 'Uninteresting', session.finish
+
+		session = @classifier.session :margin => 1000
+		carried = lambda { session.instance_variable_get(:@carry) }
+		session << "I hate "
+		1000.times { session << "x" * 1024 }
+		assert_nil carried.call
+		session << ",cheap bad words"
+		assert_equal "words".b, carried.call
+		session.finish
+		expected = @classifier.classifications("I hate xxx bad words")
+		session.classifications.each { |category, score| assert_in_delta expected[category], score, 1e-9 }
+	end
 end
@@ -0,0 +1,72 @@
+require_relative '../test_helper'
+require 'tmpdir'
+
+class DiskStoreTest < Minitest::Test
+	def setup
+		@dir = Dir.mktmpdir
+		@path = File.join(@dir, "bayes.counts")
+	end
+
+	def teardown
+		FileUtils.remove_entry @dir
+	end
+
+	def train(classifier)
+		classifier.train_interesting "here are some good words. I hope you love them"
+		classifier.train_uninteresting "here are some bad words, I hate you"
+		classifier.train_uninteresting "bad bad words"
+		classifier.untrain_uninteresting "bad bad words"
+	end
+
+	def test_matches_in_memory_classifier
+		memory = Classifier::Bayes.new 'Interesting', 'Uninteresting'
+		store = Classifier::Bayes::DiskStore.new @path, :cache => 3, :batch => 2
+		disk = Classifier::Bayes.new 'Interesting', 'Uninteresting', :vocabulary => memory.vocabulary, :store => store
+		train memory
+		train disk
+		assert_equal memory.classifications("I hate bad words and you"), disk.classifications("I hate bad words and you")
+		assert_equal 'Uninteresting', disk.classify("I hate bad words and you")
+	end
+
+	def test_reopen_existing_store
+		memory = Classifier::Bayes.new 'Interesting', 'Uninteresting'
+		train memory
+		store = Classifier::Bayes::DiskStore.new @path
+		train Classifier::Bayes.new('Interesting', 'Uninteresting', :vocabulary => memory.vocabulary, :store => store)
+		store.close
+		store = Classifier::Bayes::DiskStore.new @path
+		reopened = Classifier::Bayes.new 'Interesting', 'Uninteresting', :vocabulary => memory.vocabulary, :store => store
+		assert_equal memory.classifications("I hate bad words and you"), reopened.classifications("I hate bad words and you")
+		assert_equal memory.instance_variable_get(:@total_words), reopened.instance_variable_get(:@total_words)
+		[memory, reopened].each { |classifier| classifier.train_interesting "good words" }
+		assert_equal memory.classifications("good bad words"), reopened.classifications("good bad words")
+	end
+
+	def test_reopen_after_marshal
+		store = Classifier::Bayes::DiskStore.new @path
+		classifier = Classifier::Bayes.new 'Interesting', 'Uninteresting', :store => store
+		train classifier
+		dump = Marshal.dump(classifier)
+		store.close
+		loaded = Marshal.load(dump)
+		assert_equal 'Uninteresting', loaded.classify("I hate bad words and you")
+		assert_equal 'Interesting', loaded.classify("I hope you love them")
+	end
+
+	def test_many_categories
+		names = (1..1000).collect { |i| "Category #{i}" }
+		memory = Classifier::Bayes.new(*names)
+		store = Classifier::Bayes::DiskStore.new @path, :batch => 100
+		disk = Classifier::Bayes.new(*names, :vocabulary => memory.vocabulary, :store => store)
+		[memory, disk].each do |classifier|
+			names.each_with_index { |name, i| classifier.train_counts name, "shared" => 1, "word#{i}" => i + 1 }
+		end
+		store.close
+		store = Classifier::Bayes::DiskStore.new @path
+		reopened = Classifier::Bayes.new(*names, :vocabulary => memory.vocabulary, :store => store)
+		assert_equal 1000, store.totals.size
+		assert_equal 1000 + 1, store.totals[:"Category 1000"]
+		assert_equal memory.classifications("shared word999"), reopened.classifications("shared word999")
+		assert_equal memory.classify("shared word999"), reopened.classify("shared word999")
+	end
+end
@@ -0,0 +1,109 @@
+require_relative '../test_helper'
+require 'tmpdir'
+
+class JournalTest < Minitest::Test
+	def setup
+		@dir = Dir.mktmpdir
+		@path = File.join(@dir, "bayes.journal")
+	end
+
+	def teardown
+		FileUtils.remove_entry @dir
+	end
+
+	def test_untrain_id_matches_untrain
+		plain = Classifier::Bayes.new 'Interesting', 'Uninteresting'
+		journaled = Classifier::Bayes.new 'Interesting', 'Uninteresting', :vocabulary => plain.vocabulary,
+		                                  :journal => Classifier::Bayes::Journal.new(@path)
+		[plain, journaled].each do |b|
+			b.train_interesting "here are some good words. I hope you love them"
+			b.train_uninteresting "here are some bad words, I hate you"
+		end
+		plain.train :uninteresting, "bad bad words, love"
+		journaled.train :uninteresting, "bad bad words, love", :id => "m1"
+		plain.untrain :uninteresting, "bad bad words, love"
+		assert journaled.untrain_id("m1")
+		assert_equal plain.classifications("I hate bad words and you"), journaled.classifications("I hate bad words and you")
+		assert !journaled.untrain_id("m1")
+	end
+
+	def test_untrain_id_after_select_features
+		b = Classifier::Bayes.new 'Interesting', 'Uninteresting', :journal => Classifier::Bayes::Journal.new(@path)
+		b.train :interesting, "lovely lovely lovely words words words"
+		b.train :uninteresting, "hateful hateful hateful words words words"
+		before = b.instance_variable_get(:@total_words)
+		b.train :interesting, "lovely sunshine and rainbows", :id => "m1"
+		b.select_features! 2
+		b.untrain_id "m1"
+		assert_equal before, b.instance_variable_get(:@total_words)
+		assert_equal before, b.send(:category_totals).values.inject(0) { |sum, total| sum + total }
+		b.untrain :uninteresting, "never seen tokens at all"
+		assert_equal before, b.instance_variable_get(:@total_words)
+	end
+
+	def test_ids_need_a_journal
+		b = Classifier::Bayes.new 'Interesting', 'Uninteresting'
+		assert_raises(ArgumentError) { b.train :interesting, "words", :id => "m1" }
+		assert_raises(ArgumentError) { b.untrain_id "m1" }
+		b = Classifier::Bayes.new 'Interesting', 'Uninteresting', :journal => Classifier::Bayes::Journal.new(@path)
+		b.train :interesting, "words", :id => "m1"
+		assert_raises(ArgumentError) { b.train :interesting, "more words", :id => "m1" }
+	end
+
+	def test_reopen_and_compact
+		journal = Classifier::Bayes::Journal.new @path, :segment_bytes => 64
+		20.times { |i| journal.record "m#{i}", :Spam, { i => 1, 1000 + i => 2, 5 => 3 } }
+		(0...20).step(2) { |i| journal.forget "m#{i}" }
+		journal.close
+
+		journal = Classifier::Bayes::Journal.new @path, :segment_bytes => 64
+		assert_equal 10, journal.size
+		assert !journal.include?("m4")
+		assert_equal ["Spam", [[5, 3], [7, 1], [1007, 2]]], journal.fetch("m7")
+		segments = Dir.children(@path).size
+		journal.compact
+		assert Dir.children(@path).size < segments
+		assert_equal ["Spam", [[5, 3], [7, 1], [1007, 2]]], journal.fetch("m7")
+		journal.record "m20", :Ham, { 1 => 1 }
+		journal.close
+
+		journal = Classifier::Bayes::Journal.new @path
+		assert_equal 11, journal.size
+		assert_equal ["Spam", [[5, 3], [13, 1], [1013, 2]]], journal.fetch("m13")
+		assert_equal ["Ham", [[1, 1]]], journal.fetch("m20")
+		assert_nil journal.fetch("m12")
+	end
+
+	def test_torn_record_is_cut_off
+		journal = Classifier::Bayes::Journal.new @path
+		journal.record "m1", :Spam, { 1 => 1 }
+		journal.record "m2", :Spam, { 2 => 1 }
+		journal.close
+		segment = File.join(@path, Dir.children(@path).first)
+		File.truncate segment, File.size(segment) - 1
+		journal = Classifier::Bayes::Journal.new @path
+		assert journal.include?("m1")
+		assert !journal.include?("m2")
+		journal.record "m2", :Spam, { 2 => 1 }
+		journal.close
+		assert Classifier::Bayes::Journal.new(@path).include?("m2")
+	end
+
+	def test_interrupted_compaction_is_removed
+		journal = Classifier::Bayes::Journal.new @path
+		journal.record "m1", :Spam, { 1 => 1 }
+		journal.close
+		stale = File.join(@path, "segment-000001.compact")
+		File.binwrite stale, "CLJRNL1\1partial"
+		journal = Classifier::Bayes::Journal.new @path
+		assert !File.exist?(stale)
+		assert_equal ["Spam", [[1, 1]]], journal.fetch("m1")
+	end
+
+	def test_marshal_reopens_journal
+		b = Classifier::Bayes.new 'Interesting', 'Uninteresting', :journal => Classifier::Bayes::Journal.new(@path)
+		b.train :interesting, "here are some good words", :id => "m1"
+		loaded = Marshal.load(Marshal.dump(b))
+		assert loaded.untrain_id("m1")
+	end
+end
@@ -0,0 +1,54 @@
+require_relative '../test_helper'
+
+class CascadeTest < Minitest::Test
+	def setup
+		@lsi = Classifier::LSI.new
+		@bayes = Classifier::Bayes.new 'Dog', 'Cat', 'Bird'
+		[["This text deals with dogs. Dogs.", "Dog"],
+		 ["This text involves dogs too. Dogs! ", "Dog"],
+		 ["This text revolves around cats. Cats.", "Cat"],
+		 ["This text also involves cats. Cats!", "Cat"],
+		 ["This text involves birds. Birds.", "Bird"]].each do |text, category|
+			@lsi.add_item text, category
+			@bayes.train category, text
+		end
+	end
+
+	def test_uncertain_cases_go_to_lsi
+		cascade = Classifier::Cascade.new @bayes, @lsi, :margin => 2.0
+		tricky_case = "This text revolves around dogs."
+		assert_equal "Cat", @bayes.classify(tricky_case)
+		assert_equal ["Dog", :lsi], cascade.classify_with_stage(tricky_case)
+		assert_equal ["Bird", :bayes], cascade.classify_with_stage("birds birds birds birds birds")
+
+		stats = cascade.stats
+		assert_equal 2, stats[:bayes][:calls]
+		assert_equal 1, stats[:bayes][:decided]
+		assert_equal 1, stats[:lsi][:calls]
+		assert_equal 1, stats[:lsi][:decided]
+		cascade.reset_stats
+		assert_equal 0, cascade.stats[:bayes][:calls]
+	end
+
+	def test_zero_margin_never_uses_lsi
+		cascade = Classifier::Cascade.new @bayes, @lsi, :margin => 0
+		assert_equal "Cat", cascade.classify("This text revolves around dogs.")
+		assert_equal 0, cascade.stats[:lsi][:calls]
+	end
+
+	def test_lsi_categories_named_as_bayes_names_them
+		bayes = Classifier::Bayes.new 'Big dog', 'Cat', 'Bird'
+		lsi = Classifier::LSI.new
+		[["This text deals with dogs. Dogs.", "Big dog", :big_dog],
+		 ["This text involves dogs too. Dogs! ", "Big dog", "big_dog"],
+		 ["This text revolves around cats. Cats.", "Cat", "cat"],
+		 ["This text also involves cats. Cats!", "Cat", :cat],
+		 ["This text involves birds. Birds.", "Bird", "bird"]].each do |text, category, indexed|
+			bayes.train category, text
+			lsi.add_item text, indexed
+		end
+		cascade = Classifier::Cascade.new bayes, lsi, :margin => 2.0
+		assert_equal ["Big dog", :lsi], cascade.classify_with_stage("This text revolves around dogs.")
+		assert_equal ["Bird", :bayes], cascade.classify_with_stage("birds birds birds birds birds")
+	end
+end
@@ -0,0 +1,54 @@
+require_relative '../test_helper'
+require 'stringio'
+
+class CorpusTest < Minitest::Test
+	def test_each_libsvm
+		io = StringIO.new("Dog 1:2 2:1 # a comment\n\nCat 3:1 2:1\n")
+		docs = Classifier::Corpus.each_libsvm(io, [nil, "dog", "text", "cat"]).to_a
+		assert_equal [["Dog", { "dog" => 2, "text" => 1 }], ["Cat", { "cat" => 1, "text" => 1 }]], docs
+	end
+
+	def test_each_matrix_market
+		io = StringIO.new(<<-EOS)
+%%MatrixMarket matrix coordinate integer general
+% documents by terms
+2 3 3
+2 3 1
+1 1 2
+1 2 1
+		EOS
+		docs = Classifier::Corpus.each_matrix_market(io).to_a
+		assert_equal [[1, { "1" => 2, "2" => 1 }], [2, { "3" => 1 }]], docs
+	end
+
+	def test_each_matrix_market_rejects_dense_files
+		io = StringIO.new("%%MatrixMarket matrix array real general\n1 1\n1.0\n")
+		assert_raises(ArgumentError) { Classifier::Corpus.each_matrix_market(io) { } }
+	end
+
+	def test_each_jsonl
+		io = StringIO.new(%Q({"label": "Dog", "counts": {"dog": 2}, "id": 7}\n{"category": "Cat", "counts": [["cat", 1]]}\n))
+		docs = Classifier::Corpus.each_jsonl(io).to_a
+		assert_equal ["Dog", { "dog" => 2 }], docs[0][0, 2]
+		assert_equal 7, docs[0][2]["id"]
+		assert_equal ["Cat", [["cat", 1]]], docs[1][0, 2]
+	end
+
+	def test_train_bayes_from_counts
+		bayes = Classifier::Bayes.new 'Interesting', 'Uninteresting'
+		bayes.train_counts :interesting, "good" => 1, "word" => 1, "hope" => 1, "love" => 1
+		bayes.train_counts :uninteresting, [["bad", 1], ["word", 1], ["hate", 1]]
+		assert_equal 'Uninteresting', bayes.classify("I hate bad words and you")
+		bayes.untrain_counts :uninteresting, [["bad", 1], ["word", 1], ["hate", 1]]
+		assert_equal 4, bayes.instance_variable_get(:@total_words)
+	end
+
+	def test_index_lsi_from_counts
+		lsi = Classifier::LSI.new
+		lsi.add_item_counts 1, { "dog" => 2, "text" => 1, "deal" => 1 }, "Dog"
+		lsi.add_item_counts 2, { "cat" => 2, "text" => 1, "revolv" => 1 }, "Cat"
+		lsi.add_item_counts 3, { "bird" => 2, "text" => 1, "involv" => 1 }, "Bird"
+		assert_equal [1, 2, 3], lsi.items
+		assert_equal 1, lsi.search("dogs", 1).first
+	end
+end
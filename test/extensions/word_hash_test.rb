@@ -15,6 +15,37 @@ class StringExtensionsTest < Minitest::Test
 end
 
 
+class WordStreamTest < Minitest::Test
+	def setup
+		@chunk_size = Classifier::WordStream.chunk_size
+		Classifier::WordStream.chunk_size = 5
+		@text = "here are some good words of test's. I hope you love them! Ça déçoit, naïve café... ok?\n" * 3
+	end
+
+	def teardown
+		Classifier::WordStream.chunk_size = @chunk_size
+	end
+
+	def test_same_tokens_as_string
+		assert_equal @text.word_hash, StringIO.new(@text).word_hash
+		assert_equal @text.clean_word_hash, StringIO.new(@text).clean_word_hash
+	end
+
+	def test_same_ids_as_string
+		from_string, from_io = Classifier::Vocabulary.new, Classifier::Vocabulary.new
+		assert_equal @text.word_ids(from_string), StringIO.new(@text).word_ids(from_io)
+		assert_equal from_string.to_a, from_io.to_a
+	end
+
+	def test_train_and_classify_from_io
+		b = Classifier::Bayes.new 'Interesting', 'Uninteresting'
+		b.train_interesting StringIO.new("here are some good words. I hope you love them")
+		b.train_uninteresting StringIO.new("here are some bad words, I hate you")
+		assert_equal 'Uninteresting', b.classify(StringIO.new("I hate bad words and you"))
+	end
+end
+
+
 class ArrayExtensionsTest < Minitest::Test
 
   def test_plays_nicely_with_any_array
@@ -34,3 +65,54 @@ class ArrayExtensionsTest < Minitest::Test
   end
 
 end
+
+class TokenLimitsTest < Minitest::Test
+	def teardown
+		Classifier::TokenLimits.max_bytes = nil
+		Classifier::TokenLimits.max_tokens = nil
+		Classifier::TokenLimits.max_token_length = nil
+		Classifier::TokenLimits.sample = nil
+	end
+
+	def test_max_bytes
+		Classifier::TokenLimits.max_bytes = 20
+		text = "good words here. " + "other stuff, " * 1000 + "naïve"
+		assert_equal "good words here. oth".clean_word_hash, text.clean_word_hash
+		assert_equal "good words here. oth".word_hash, StringIO.new(text).word_hash
+		Classifier::TokenLimits.max_bytes = 4
+		assert_equal({}, "naïve".clean_word_hash)
+	end
+
+	def test_sample
+		Classifier::TokenLimits.max_bytes = 30
+		Classifier::TokenLimits.sample = 3
+		text = "apples bananas " + "filler " * 1000 + "cherries dates " + "filler " * 1000 + "figs grapes"
+		words = text.clean_word_hash
+		assert words.has_key?(:appl)
+		assert words.has_key?(:grape)
+		assert words.keys.size <= 6
+	end
+
+	def test_max_tokens
+		Classifier::TokenLimits.max_tokens = 2
+		text = "apples bananas apples cherries bananas apples"
+		assert_equal({ :appl => 3, :banana => 2 }, text.clean_word_hash)
+		assert_equal({ :appl => 3, :banana => 2 }, StringIO.new(text).clean_word_hash)
+	end
+
+	def test_max_token_length
+		Classifier::TokenLimits.max_token_length = 10
+		text = "apples QUJDREVGR0hJSktMTU5PUFFSU1RVVldYWVo= bananas !!!!!!!!!!!! ?"
+		assert_equal({ :appl => 1, :banana => 1, :"=" => 1, :"?" => 1 }, text.word_hash)
+		assert_equal text.word_hash, StringIO.new(text).word_hash
+	end
+
+	def test_run_without_whitespace
+		Classifier::TokenLimits.max_token_length = 40
+		chunk_size, Classifier::WordStream.chunk_size = Classifier::WordStream.chunk_size, 1000
+		text = "good words " + "x" * (Classifier::WordStream::MAX_RUN * 3) + ",tail bananas"
+		assert_equal({ :good => 1, :word => 1, :banana => 1 }, StringIO.new(text).clean_word_hash)
+	ensure
+		Classifier::WordStream.chunk_size = chunk_size
+	end
+end
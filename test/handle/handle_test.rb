@@ -0,0 +1,46 @@
+require_relative '../test_helper'
+require 'tmpdir'
+
+class HandleTest < Minitest::Test
+	def setup
+		@old = Classifier::Bayes.new 'Interesting', 'Uninteresting'
+		@old.train_interesting "here are some good words. I hope you love them"
+		@old.train_uninteresting "here are some bad words, I hate you"
+		@new = Classifier::Bayes.new 'Interesting', 'Uninteresting'
+		@new.train_interesting "here are some bad words, I hate you"
+		@new.train_uninteresting "here are some good words. I hope you love them"
+		@released = []
+		@handle = Classifier::Handle.new @old, :on_release => lambda { |model| @released << model }
+	end
+
+	def test_delegates_to_current_model
+		assert_equal 'Uninteresting', @handle.classify("I hate bad words and you")
+		assert @handle.respond_to?(:classifications)
+		@handle.swap @new
+		assert_equal 'Interesting', @handle.classify("I hate bad words and you")
+		assert_equal [@old], @released
+	end
+
+	def test_old_model_released_after_readers_drain
+		@handle.with do |model|
+			@handle.swap @new
+			assert_same @old, model
+			assert_equal 'Uninteresting', model.classify("I hate bad words and you")
+			assert_empty @released
+		end
+		assert_equal [@old], @released
+	end
+
+	def test_reload_in_background
+		Dir.mktmpdir do |dir|
+			path = File.join(dir, "bayes.model")
+			File.binwrite(path, Marshal.dump(@new))
+			@handle.reload(path).join
+			assert_equal 'Interesting', @handle.classify("I hate bad words and you")
+
+			File.binwrite(path, "not a model")
+			assert_raises(TypeError, ArgumentError) { @handle.reload(path).join }
+			assert_equal 'Interesting', @handle.classify("I hate bad words and you")
+		end
+	end
+end
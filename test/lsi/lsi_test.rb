@@ -21,6 +21,27 @@ class LSITest < Minitest::Test
 	 assert_equal [@str2, @str5, @str3], lsi.find_related(@str1, 3)
 	end
 
+	def test_remove_item
+	  lsi = Classifier::LSI.new
+	  [@str1, @str2, @str3, @str4, @str5].each { |x| lsi << x }
+	  lsi.remove_item @str2
+	  assert_equal [@str1, @str3, @str4, @str5], lsi.items
+	  lsi.build_index
+	  assert_equal @str1, lsi.search("dog", 5).first
+	  assert !lsi.search("dog", 5).include?(@str2)
+	end
+
+	def test_classify_unrelated_content
+	  lsi = Classifier::LSI.new
+	  lsi.add_item @str1, "Dog"
+	  lsi.add_item @str3, "Cat"
+	  category = lsi.classify "zebra xylophone quartz"
+	  assert category.nil? || ["Dog", "Cat"].include?(category)
+	  scores = lsi.proximity_array_for_content("zebra xylophone quartz").collect { |item, score| score }
+	  assert_equal 2, scores.size
+	  assert scores.none? { |score| score.nan? }
+	end
+
 	def test_not_auto_rebuild
 	 lsi = Classifier::LSI.new :auto_rebuild => false
 	 lsi.add_item @str1, "Dog"
@@ -30,6 +51,118 @@ class LSITest < Minitest::Test
 	 assert ! lsi.needs_rebuild?
 	end
 
+	def test_cooperative_rebuild
+	  lsi = Classifier::LSI.new :auto_rebuild => false
+	  [@str1, @str2, @str3, @str4, @str5].each { |x| lsi << x }
+	  pauses = 0
+	  lsi.build_index_cooperatively(0.75, 2) { pauses += 1 }
+	  assert pauses > 2
+	  assert ! lsi.needs_rebuild?
+	  assert_equal [@str2, @str5, @str3], lsi.find_related(@str1, 3)
+	end
+
+	def test_rollback
+	  lsi = Classifier::LSI.new :auto_rebuild => false, :versions => 2
+	  [@str1, @str2, @str3, @str4].each { |x| lsi << x }
+	  lsi.build_index
+	  first = lsi.versions.last
+	  before = lsi.find_related(@str1, 3)
+
+	  lsi << @str5
+	  lsi.remove_item @str2
+	  lsi.build_index
+	  assert_equal 2, lsi.versions.size
+	  assert ! lsi.items.include?(@str2)
+
+	  lsi.rollback_to first
+	  assert ! lsi.needs_rebuild?
+	  assert_equal [@str1, @str2, @str3, @str4], lsi.items
+	  assert_equal before, lsi.find_related(@str1, 3)
+
+	  loaded = Marshal.load(Marshal.dump(lsi))
+	  assert_equal lsi.versions, loaded.versions
+	  assert_raises(ArgumentError) { lsi.rollback_to(-5) }
+	end
+
+	def test_load_baseline_dump
+	  # Marshaled by the index as it was before items had handles and words
+	  # had ids, after adding @str1 to @str5 with categories.
+	  loaded = Marshal.load(File.binread(File.dirname(__FILE__) + '/baseline_lsi.dump'))
+	  lsi = Classifier::LSI.new
+	  lsi.add_item @str1, "Dog"
+	  lsi.add_item @str2, "Dog"
+	  lsi.add_item @str3, "Cat"
+	  lsi.add_item @str4, "Cat"
+	  lsi.add_item @str5, "Bird"
+	  assert ! loaded.needs_rebuild?
+	  assert_equal lsi.items, loaded.items
+	  assert_equal lsi.find_related(@str3, 2), loaded.find_related(@str3, 2)
+	  assert_equal "Dog", loaded.classify("This text is about dogs")
+	  assert_equal ["Cat"], loaded.categories_for(@str4)
+
+	  loaded.add_item "This text is all about cats. Cats.", "Cat"
+	  assert_equal "Cat", loaded.classify("Cats and more cats")
+	  reloaded = Marshal.load(Marshal.dump(loaded))
+	  assert_equal loaded.find_related(@str1, 3), reloaded.find_related(@str1, 3)
+	end
+
+	def test_rollback_after_marshal
+	  lsi = Classifier::LSI.new :auto_rebuild => false, :versions => 2
+	  [@str1, @str2, @str3, @str4, @str5].each { |x| lsi.add_item x, "Animal" }
+	  lsi.build_index
+	  first = lsi.versions.last
+
+	  lsi = Marshal.load(Marshal.dump(lsi))
+	  lsi.add_item "Fish swim in water. Fish.", "Fish"
+	  lsi.remove_item @str5
+	  lsi.categories_for(@str1) << "Dog"
+	  lsi.build_index
+	  assert_equal ["Animal", "Dog"], lsi.categories_for(@str1)
+
+	  lsi.rollback_to first
+	  assert_equal [@str1, @str2, @str3, @str4, @str5], lsi.items
+	  assert_equal ["Animal"], lsi.categories_for(@str1)
+	end
+
+	def test_item_handles
+	  lsi = Classifier::LSI.new
+	  handles = [@str1, @str2, @str3, @str4, @str5].collect { |x| lsi.add_item x }
+	  assert_equal [0, 1, 2, 3, 4], handles
+	  assert_equal 2, lsi.handle_for(@str3)
+	  assert_equal @str3, lsi.item_for(2)
+
+	  lsi.auto_rebuild = false
+	  seen = handles.dup
+	  100.times do |i|
+	    lsi.remove_item @str2
+	    seen << lsi.add_item(@str2)
+	    lsi.remove_item(i == 0 ? @str4 : "Text number #{i - 1}")
+	    seen << lsi.add_item("Text number #{i}")
+	  end
+	  assert_equal seen.uniq, seen
+	  assert_nil lsi.item_for(1)
+	  assert_equal 5, lsi.instance_variable_get(:@nodes).size
+	  assert_equal 5, lsi.instance_variable_get(:@item_for).size
+	  assert_equal @str2, lsi.item_for(lsi.handle_for(@str2))
+	  assert_nil lsi.handle_for(@str4)
+	end
+
+	def test_without_retaining_items
+	  lsi = Classifier::LSI.new :retain_items => false
+	  lsi.add_item @str1, "Dog"
+	  lsi.add_item @str2, "Dog"
+	  lsi.add_item @str3, "Cat"
+	  lsi.add_item @str4, "Cat"
+	  lsi.add_item @str5, "Bird"
+	  assert_nil lsi.item_for(0)
+	  assert_equal [0, 1, 2, 3, 4], lsi.items
+	  assert_equal [1, 4, 2], lsi.find_related(@str1, 3)
+	  assert_equal ["Cat"], lsi.categories_for(@str3)
+	  assert_equal "Dog", lsi.classify("This text revolves around dogs.")
+	  lsi.remove_item @str5
+	  assert_equal [0, 1, 2, 3], lsi.items
+	end
+
 	def test_basic_categorizing
 	  lsi = Classifier::LSI.new
 	  lsi.add_item @str2, "Dog"
@@ -95,6 +228,44 @@ class LSITest < Minitest::Test
 	                lsi.search("dog", 5) )
 	end
 
+	def test_budgeted_queries
+	  lsi = Classifier::LSI.new
+	  [@str1, @str2, @str3, @str4, @str5].each { |x| lsi << x }
+
+	  budget = Classifier::LSI::Budget.new :time => 60
+	  assert_equal lsi.search("dog", 5), lsi.search("dog", 5, budget)
+	  assert ! budget.partial?
+
+	  budget = Classifier::LSI::Budget.new :items => 2
+	  result = lsi.search("dog", 5, budget)
+	  assert budget.partial?
+	  assert_equal 2, result.size
+	  assert_equal lsi.search("dog", 1), result[0, 1]
+
+	  budget = Classifier::LSI::Budget.new :items => 0
+	  assert_nil lsi.classify(@str1, 0.3, budget)
+	  assert budget.partial?
+	end
+
+	def test_related_terms
+	  lsi = Classifier::LSI.new
+	  [@str1, @str2, @str3, @str4, @str5].each { |x| lsi << x }
+
+	  assert_equal "deal", lsi.related_terms("dogs", 1).first
+	  assert_equal 4, lsi.related_terms(:dog, 4).size
+	  assert !lsi.related_terms("dog", 100).include?("dog")
+	  assert_equal [], lsi.related_terms("zebra")
+	end
+
+	def test_more_documents_than_terms
+	  lsi = Classifier::LSI.new :auto_rebuild => false
+	  docs = ["dogs dogs cats", "cats cats", "dogs birds", "birds birds dogs", "cats birds", "dogs dogs"]
+	  docs.each { |x| lsi << x }
+	  lsi.build_index
+	  assert_equal "dogs dogs", lsi.search("dogs", 1).first
+	  assert_equal 2, lsi.related_terms("dog").size
+	end
+
 	def test_serialize_safe
     lsi = Classifier::LSI.new
 	  [@str1, @str2, @str3, @str4, @str5].each { |x| lsi << x }
@@ -104,6 +275,7 @@ class LSITest < Minitest::Test
 
 	  assert_equal lsi_m.search("cat", 3), lsi.search("cat", 3)
 	  assert_equal lsi_m.find_related(@str1, 3), lsi.find_related(@str1, 3)
+	  assert_equal lsi_m.related_terms("dog"), lsi.related_terms("dog")
 	end
 
 	def test_keyword_search
@@ -117,6 +289,18 @@ class LSITest < Minitest::Test
 	  assert_equal [:dog, :text, :deal], lsi.highest_ranked_stems(@str1)
 	end
 
+	def test_keywords_for_all
+	  lsi = Classifier::LSI.new
+	  [@str1, @str2, @str3, @str4, @str5].each { |x| lsi << x }
+
+	  keywords = lsi.keywords_for_all(3)
+	  assert_equal lsi.items, keywords.keys
+	  assert_equal ["dog", "text", "deal"], keywords[@str1]
+	  lsi.items.each do |item|
+	    assert_equal lsi.highest_ranked_stems(item, 2).collect { |stem| stem.to_s }, keywords[item][0, 2]
+	  end
+	end
+
 	def test_summary
 	   assert_equal "This text involves dogs too [...] This text also involves cats", [@str1, @str2, @str3, @str4, @str5].join.summary(2)
 	end
@@ -0,0 +1,196 @@
+# Profiling harness for Classifier. It runs one of a set of canned scenarios
+# on the synthetic document stream of the soak test, and writes out where the
+# time and the allocations go, so that performance reports can come with a
+# reproducible profile attached.
+#
+# Run it with `rake profile[scenario]`, or without a scenario for the list.
+# Tunables (environment variables):
+#
+#   PROFILE_SCALE  multiplies the size of every scenario (default 1.0)
+#   PROFILE_OUT    directory the profiles are written to (default tmp/profile)
+#   PROFILE_SEED   random seed for the synthetic stream (default 1234)
+#
+# Each scenario writes, into PROFILE_OUT:
+#
+#   <scenario>-cpu.folded    sampled call stacks, in the folded format read by
+#                            flamegraph.pl and speedscope
+#   <scenario>-alloc.folded  allocations by method and line, in the same format
+#   <scenario>-alloc.txt     the allocation tables, by method and by line
+#
+# The built-in sampler can only run when the profiled thread gives up the
+# interpreter lock, which limits it to a few dozen samples a second; it is
+# meant for scenarios that run for seconds. When the stackprof gem is
+# installed, <scenario>-cpu.dump and <scenario>-object.dump are written as
+# well, for `stackprof --d3-flamegraph` and the other stackprof reports.
+#
+# The LSI build scenarios are only practical with GSL installed; without it,
+# run them with a small PROFILE_SCALE.
+
+require_relative '../soak/soak'
+require 'fileutils'
+
+module Profile
+  SCALE = (ENV['PROFILE_SCALE'] || 1.0).to_f
+  OUT   = ENV['PROFILE_OUT'] || 'tmp/profile'
+  SEED  = (ENV['PROFILE_SEED'] || 1234).to_i
+  LIB   = File.expand_path('../../lib', File.dirname(__FILE__))
+
+  # Returns n scaled by PROFILE_SCALE, but at least 2.
+  def self.scaled(n)
+    [(n * SCALE).round, 2].max
+  end
+
+  def self.documents(stream, count, length = nil)
+    Array.new(count) do
+      category = stream.category
+      [category, length ? stream.document(category, length) : stream.document(category)]
+    end
+  end
+
+  # Each scenario prepares its data and returns the work to be profiled, so
+  # that only the work itself is measured. Every profile gets a fresh one.
+  SCENARIOS = {
+    'bayes_train' => lambda do |stream|
+      docs = documents(stream, scaled(5000))
+      bayes = Classifier::Bayes.new(*Soak::CATEGORIES)
+      lambda { docs.each { |category, text| bayes.train category, text } }
+    end,
+
+    'bayes_classify' => lambda do |stream|
+      bayes = Classifier::Bayes.new(*Soak::CATEGORIES)
+      documents(stream, scaled(2000)).each { |category, text| bayes.train category, text }
+      emails = documents(stream, scaled(200), 2000)
+      lambda { emails.each { |category, text| bayes.classify text } }
+    end,
+
+    'lsi_build_1k' => lambda do |stream|
+      lsi = Classifier::LSI.new :auto_rebuild => false
+      documents(stream, scaled(1000)).each { |category, text| lsi.add_item text, category }
+      lambda { lsi.build_index }
+    end,
+
+    'lsi_build_10k' => lambda do |stream|
+      lsi = Classifier::LSI.new :auto_rebuild => false
+      documents(stream, scaled(10000)).each { |category, text| lsi.add_item text, category }
+      lambda { lsi.build_index }
+    end,
+
+    'lsi_search' => lambda do |stream|
+      lsi = Classifier::LSI.new :auto_rebuild => false
+      documents(stream, scaled(200)).each { |category, text| lsi.add_item text, category }
+      lsi.build_index
+      queries = Array.new(scaled(500)) { stream.document(stream.category, 3) }
+      lambda { queries.each { |query| lsi.search query, 5 } }
+    end,
+
+    'summary' => lambda do |stream|
+      texts = Array.new(scaled(20)) { Array.new(60) { stream.document(stream.category) }.join(" ") }
+      lambda { texts.each { |text| text.summary 5 } }
+    end,
+  }
+
+  # Samples the call stack of +thread+ while the block runs, returning a
+  # Hash of folded stack => sample count.
+  def self.sample(thread = Thread.current)
+    stacks = Hash.new(0)
+    sampler = Thread.new do
+      loop do
+        sleep 0.001
+        locations = thread.backtrace_locations
+        next unless locations
+        frames = locations.reverse.collect { |l| "#{l.label} (#{l.path.sub(LIB + '/', '')}:#{l.lineno})" }
+        stacks[frames.join(";")] += 1
+      end
+    end
+    # A lower priority shortens the time slice of the profiled thread, so
+    # that the sampler gets to run more often.
+    priority, thread.priority = thread.priority, -3
+    yield
+    stacks
+  ensure
+    thread.priority = priority if priority
+    sampler.kill if sampler
+  end
+
+  # Traces every allocation made by the block, with GC disabled so that
+  # short-lived objects are counted too, and returns the count of objects
+  # allocated by Classifier, by method and by line.
+  def self.allocations
+    by_method, by_line = Hash.new(0), Hash.new(0)
+    GC.start
+    GC.disable
+    begin
+      ObjectSpace.trace_object_allocations do
+        yield
+        ObjectSpace.each_object do |obj|
+          file = ObjectSpace.allocation_sourcefile(obj)
+          next unless file && file.start_with?(LIB)
+          method = "#{ObjectSpace.allocation_class_path(obj)}##{ObjectSpace.allocation_method_id(obj)}"
+          by_method[method] += 1
+          by_line[[method, "#{file.sub(LIB + '/', '')}:#{ObjectSpace.allocation_sourceline(obj)}"]] += 1
+        end
+      end
+    ensure
+      GC.enable
+    end
+    ObjectSpace.trace_object_allocations_clear
+    return by_method, by_line
+  end
+
+  def self.stackprof(name, mode, work)
+    require 'stackprof'
+    StackProf.run(:mode => mode, :raw => true, :out => File.join(OUT, "#{name}-#{mode == :object ? 'object' : 'cpu'}.dump")) { work.call }
+  rescue LoadError
+    nil
+  end
+
+  def self.write_folded(path, counts)
+    File.open(path, "w") do |f|
+      counts.sort_by { |stack, n| -n }.each { |stack, n| f.puts "#{stack} #{n}" }
+    end
+  end
+
+  def self.table(title, counts, total, limit = 30)
+    lines = ["#{title}:"]
+    counts.sort_by { |key, n| -n }[0, limit].each do |key, n|
+      lines << "  %10d  %5.1f%%  %s" % [n, 100.0 * n / [total, 1].max, key]
+    end
+    lines.join("\n")
+  end
+
+  def self.run(name)
+    scenario = SCENARIOS[name]
+    unless scenario
+      puts "Usage: rake profile[scenario], where scenario is one of:"
+      SCENARIOS.keys.each { |key| puts "  #{key}" }
+      exit(name ? 1 : 0)
+    end
+    FileUtils.mkdir_p OUT
+
+    work = scenario.call(Soak::Stream.new(SEED))
+    started = Process.clock_gettime(Process::CLOCK_MONOTONIC)
+    stacks = sample { work.call }
+    elapsed = Process.clock_gettime(Process::CLOCK_MONOTONIC) - started
+    write_folded File.join(OUT, "#{name}-cpu.folded"), stacks
+
+    # The scenario is set up outside the traced block, so that only the
+    # work itself is counted.
+    work = scenario.call(Soak::Stream.new(SEED))
+    by_method, by_line = allocations { work.call }
+    total = by_method.values.inject(0) { |sum, n| sum + n }
+    write_folded File.join(OUT, "#{name}-alloc.folded"), by_line.collect { |(method, line), n| ["#{method};#{line}", n] }
+    report = [
+      "#{name}: %.3fs, #{total} allocations by Classifier" % elapsed,
+      table("Allocations by method", by_method, total),
+      table("Allocations by line", by_line.collect { |(method, line), n| ["#{line}  #{method}", n] }, total),
+    ].join("\n\n")
+    File.write(File.join(OUT, "#{name}-alloc.txt"), report + "\n")
+
+    dumps = [:cpu, :object].collect { |mode| stackprof(name, mode, scenario.call(Soak::Stream.new(SEED))) }
+    puts report
+    puts "\nProfiles written to #{OUT}/#{name}-*"
+    puts "stackprof is not installed; only the folded profiles were written." unless dumps.all?
+  end
+end
+
+Profile.run(ARGV[0]) if $0 == __FILE__
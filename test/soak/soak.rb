@@ -0,0 +1,272 @@
+# Long-running soak test for Classifier. It drives Bayes and LSI through
+# many train/untrain/classify/add_item/remove_item cycles on a synthetic,
+# bounded vocabulary, and fails if memory or live objects keep growing once
+# the models have reached their steady-state size.
+#
+# Run it with `rake soak`. Tunables (environment variables):
+#
+#   SOAK_CYCLES        total cycles to run (default 1_000_000)
+#   SOAK_SAMPLES       number of memory samples taken (default 20)
+#   SOAK_RSS_SLACK     allowed RSS growth after warmup, in KB (default 32768)
+#   SOAK_OBJECT_SLACK  allowed live-object growth after warmup, as a ratio (default 0.10)
+#   SOAK_PROFILE       if set, number of cycles per hot path to trace for the
+#                      allocation profile (default 2000, 0 disables it)
+#   SOAK_SEED          random seed for the synthetic stream (default 1234)
+
+$:.unshift(File.dirname(__FILE__) + '/../../lib')
+
+require 'classifier'
+require 'objspace'
+
+module Soak
+  CYCLES        = (ENV['SOAK_CYCLES'] || 1_000_000).to_i
+  SAMPLES       = (ENV['SOAK_SAMPLES'] || 20).to_i
+  RSS_SLACK     = (ENV['SOAK_RSS_SLACK'] || 32768).to_i
+  OBJECT_SLACK  = (ENV['SOAK_OBJECT_SLACK'] || 0.10).to_f
+  PROFILE       = (ENV['SOAK_PROFILE'] || 2000).to_i
+  SEED          = (ENV['SOAK_SEED'] || 1234).to_i
+
+  CATEGORIES    = %w(Alpha Beta Gamma Delta)
+  UNIVERSE      = 3000  # distinct words in the synthetic stream
+  TOKENS        = UNIVERSE + 1  # those words plus the full stop ending each document
+  BAYES_WINDOW  = 500   # documents kept trained before the oldest is untrained
+  LSI_WINDOW    = 12    # items kept indexed before the oldest is removed
+  LSI_EVERY     = 50    # Bayes cycles per LSI cycle
+  REBUILD_EVERY = 200   # LSI cycles per build_index
+
+  # Generates documents from a fixed universe of pronounceable words, with a
+  # skewed distribution so each category has a few characteristic terms.
+  class Stream
+    SYLLABLES = %w(ka lo mi ne ru sa te vo zu pa di fe go hu ji)
+
+    def initialize(seed)
+      @random = Random.new(seed)
+      @words = Array.new(UNIVERSE) { |i| word_for(i) }
+      @serial = 0
+    end
+
+    def document(category, length = 20 + @random.rand(40))
+      offset = CATEGORIES.index(category) * UNIVERSE.div(CATEGORIES.size)
+      Array.new(length) do
+        rank = (@random.rand ** 3 * UNIVERSE).to_i
+        @words[(rank + offset) % UNIVERSE]
+      end.join(" ") + "."
+    end
+
+    # A document sprinkled with words that have never been seen before. Used
+    # for classification, which must not grow the models.
+    def query(category)
+      @serial += 1
+      document(category, 20) + " unseen#{@serial}x quux#{@serial}zz"
+    end
+
+    def category
+      CATEGORIES[@random.rand(CATEGORIES.size)]
+    end
+
+    private
+
+    def word_for(i)
+      word = ""
+      begin
+        i, syllable = i.divmod(SYLLABLES.size)
+        word << SYLLABLES[syllable]
+      end while i > 0
+      word + "ter"
+    end
+  end
+
+  class Runner
+    attr_reader :bayes, :lsi
+
+    def initialize
+      @stream = Stream.new(SEED)
+      @bayes = Classifier::Bayes.new(*CATEGORIES)
+      @lsi = Classifier::LSI.new :auto_rebuild => false
+      @trained, @indexed = [], []
+      @lsi_cycles, @built = 0, false
+    end
+
+    def cycle(n)
+      bayes_train
+      bayes_untrain if @trained.size > BAYES_WINDOW
+      bayes_classify
+      lsi_cycle if n % LSI_EVERY == 0
+    end
+
+    def bayes_train
+      category = @stream.category
+      text = @stream.document(category)
+      @bayes.train category, text
+      @trained << [category, text]
+    end
+
+    def bayes_untrain
+      category, text = @trained.shift
+      @bayes.untrain category, text
+    end
+
+    def bayes_classify
+      @bayes.classify @stream.query(@stream.category)
+    end
+
+    def lsi_cycle
+      @lsi_cycles += 1
+      lsi_add_item
+      lsi_remove_item if @indexed.size > LSI_WINDOW
+      lsi_build_index if @lsi_cycles % REBUILD_EVERY == 0
+      lsi_classify if @built && !@lsi.needs_rebuild?
+    end
+
+    def lsi_add_item
+      category = @stream.category
+      text = @stream.document(category, 15)
+      @lsi.add_item text, category
+      @indexed << text
+    end
+
+    def lsi_remove_item
+      @lsi.remove_item @indexed.shift
+    end
+
+    def lsi_build_index
+      @lsi.build_index
+      @built = true
+    end
+
+    def lsi_classify
+      @lsi.classify @stream.query(@stream.category)
+    end
+
+    # Sizes of the structures that must stay bounded, independent of the
+    # process-level measurements.
+    def model_sizes
+      {
+        :bayes_vocabulary => @bayes.vocabulary.size,
+        :bayes_entries    => @bayes.instance_variable_get(:@categories).values.inject(0) { |sum, words| sum + words.size },
+        :lsi_vocabulary   => @lsi.vocabulary.size,
+        :lsi_items        => @lsi.items.size,
+      }
+    end
+  end
+
+  module_function
+
+  # Resident set size of this process in KB.
+  def rss
+    status = "/proc/#{Process.pid}/status"
+    if File.exist?(status)
+      File.read(status)[/^VmRSS:\s+(\d+)/, 1].to_i
+    else
+      `ps -o rss= -p #{Process.pid}`.to_i
+    end
+  end
+
+  def live_objects
+    GC.start
+    counts = ObjectSpace.count_objects
+    counts[:TOTAL] - counts[:FREE]
+  end
+
+  def sample(runner, cycle)
+    { :cycle => cycle, :rss => rss, :objects => live_objects,
+      :symbols => Symbol.all_symbols.size }.merge(runner.model_sizes)
+  end
+
+  def report(sample)
+    puts sample.collect { |key, value| "#{key}=#{value}" }.join(" ")
+    $stdout.flush
+  end
+
+  # Traces every allocation made by +count+ runs of each hot path, with GC
+  # disabled so that short-lived objects are counted too, and prints the
+  # library lines responsible for most of them.
+  def profile(runner, count)
+    lib = File.expand_path('../../lib', File.dirname(__FILE__))
+    paths = {
+      'Bayes#train'        => lambda { runner.bayes_train },
+      'Bayes#untrain'      => lambda { runner.bayes_untrain },
+      'Bayes#classify'     => lambda { runner.bayes_classify },
+      'LSI#add_item'       => lambda { runner.lsi_add_item },
+      'LSI#remove_item'    => lambda { runner.lsi_remove_item },
+      'LSI#classify'       => lambda { runner.lsi_classify },
+    }
+    runner.lsi_build_index
+    paths.each do |name, path|
+      runs = name =~ /^LSI/ ? [count.div(LSI_EVERY), 1].max : count
+      sites = Hash.new(0)
+      GC.start
+      GC.disable
+      begin
+        ObjectSpace.trace_object_allocations do
+          runs.times { path.call }
+          ObjectSpace.each_object do |obj|
+            file = ObjectSpace.allocation_sourcefile(obj)
+            next unless file && file.start_with?(lib)
+            sites["#{file.sub(lib + '/', '')}:#{ObjectSpace.allocation_sourceline(obj)}"] += 1
+          end
+        end
+      ensure
+        GC.enable
+      end
+      ObjectSpace.trace_object_allocations_clear
+      runner.lsi_build_index if name == 'LSI#remove_item'
+
+      total = sites.values.inject(0) { |sum, n| sum + n }
+      puts "\n#{name}: #{total} allocations in #{runs} calls (#{total.div(runs)} per call)"
+      sites.sort_by { |site, n| -n }[0, 10].each do |site, n|
+        puts "  %10d  %s" % [n, site]
+      end
+    end
+  end
+
+  def run
+    runner = Runner.new
+    warmup = CYCLES.div(10)
+    interval = [(CYCLES - warmup).div([SAMPLES, 1].max), 1].max
+    puts "Soaking for #{CYCLES} cycles (warmup #{warmup}, sampling every #{interval})"
+
+    warmup.times { |n| runner.cycle(n) }
+    baseline = sample(runner, warmup)
+    report baseline
+    samples = [baseline]
+    (warmup...CYCLES).each do |n|
+      runner.cycle(n)
+      if (n + 1 - warmup) % interval == 0
+        samples << sample(runner, n + 1)
+        report samples.last
+      end
+    end
+
+    profile(runner, PROFILE) if PROFILE > 0
+
+    final = samples.last
+    failures = []
+    if final[:rss] - baseline[:rss] > RSS_SLACK
+      failures << "RSS grew by #{final[:rss] - baseline[:rss]} KB (allowed #{RSS_SLACK} KB)"
+    end
+    if final[:objects] > baseline[:objects] * (1 + OBJECT_SLACK)
+      failures << "live objects grew from #{baseline[:objects]} to #{final[:objects]}"
+    end
+    [:bayes_vocabulary, :lsi_vocabulary].each do |key|
+      failures << "#{key} exceeded the synthetic universe (#{final[key]})" if final[key] > TOKENS
+    end
+    if final[:bayes_entries] > TOKENS * CATEGORIES.size
+      failures << "Bayes holds #{final[:bayes_entries]} entries for #{UNIVERSE} words"
+    end
+    if final[:symbols] > baseline[:symbols] * (1 + OBJECT_SLACK)
+      failures << "symbol table grew from #{baseline[:symbols]} to #{final[:symbols]}"
+    end
+    failures << "LSI holds #{final[:lsi_items]} items" if final[:lsi_items] > LSI_WINDOW
+
+    if failures.empty?
+      puts "\nSoak passed."
+    else
+      puts "\nSoak FAILED:"
+      failures.each { |failure| puts "  #{failure}" }
+      exit 1
+    end
+  end
+end
+
+Soak.run if $0 == __FILE__
@@ -0,0 +1,164 @@
+require_relative '../test_helper'
+require 'tempfile'
+
+class VocabularyTest < Minitest::Test
+	def setup
+		@vocab = Classifier::Vocabulary.new
+	end
+
+	def test_add_assigns_sequential_ids
+		assert_equal 0, @vocab.add("dog")
+		assert_equal 1, @vocab.add(:cat)
+		assert_equal 0, @vocab.add("dog")
+		assert_equal 2, @vocab.size
+		assert_equal 1, @vocab["cat"]
+		assert_equal "dog", @vocab.word_for(0)
+		assert_nil @vocab["bird"]
+	end
+
+	def test_frozen_vocabulary_does_not_grow
+		@vocab.add "dog"
+		@vocab.freeze
+		assert_equal 0, @vocab.add("dog")
+		assert_nil @vocab.add("cat")
+		assert_equal 1, @vocab.size
+	end
+
+	def test_save_and_load
+		%w(dog cat bird).each { |word| @vocab.add word }
+		file = Tempfile.new('vocabulary')
+		@vocab.save file.path
+		loaded = Classifier::Vocabulary.load(file.path)
+		assert_equal @vocab.to_a, loaded.to_a
+		assert_equal 2, loaded["bird"]
+	ensure
+		file.close! if file
+	end
+
+	def test_serialize_safe
+		%w(dog cat bird).each { |word| @vocab.add word }
+		@vocab.freeze
+		loaded = Marshal.load(Marshal.dump(@vocab))
+		assert_equal @vocab.to_a, loaded.to_a
+		assert_equal 1, loaded["cat"]
+		assert loaded.frozen?
+	end
+
+	def test_word_ids
+		ids = "here are some good words of test's. I hope you love them!".word_ids(@vocab)
+		expected = "here are some good words of test's. I hope you love them!".word_hash
+		assert_equal expected.size, ids.size
+		expected.each { |word, count| assert_equal count, ids[@vocab[word]] }
+	end
+
+	def test_word_ids_without_growing
+		@vocab.add "good"
+		assert_equal({ 0 => 1 }, "good words".clean_word_ids(@vocab, false))
+		assert_equal 1, @vocab.size
+	end
+
+	def test_ids_for_checks_integer_ids
+		@vocab.add "good"
+		assert_equal({ 0 => 2, 1 => 1 }, @vocab.ids_for([[0, 1], ["words", 1], ["good", 1]]))
+		assert_raises(ArgumentError) { @vocab.ids_for(2 => 1) }
+		assert_raises(ArgumentError) { @vocab.ids_for(-1 => 1) }
+		bayes = Classifier::Bayes.new 'Interesting', 'Uninteresting', :vocabulary => @vocab
+		assert_raises(ArgumentError) { bayes.train_counts :interesting, 99 => 1 }
+		buffer = Classifier::Bayes::TrainingBuffer.new bayes
+		assert_raises(ArgumentError) { buffer.train_counts :interesting, 99 => 1 }
+		assert_equal 0, buffer.pending
+		lsi = Classifier::LSI.new :vocabulary => @vocab
+		assert_raises(ArgumentError) { lsi.add_item_counts "doc", 99 => 1 }
+		assert_empty lsi.items
+	end
+
+	def test_concurrent_add
+		words = Array.new(2000) { |i| "word#{i}" }
+		threads = Array.new(4) { |t| Thread.new { words.rotate(t * 500).collect { |word| @vocab.add word } } }
+		ids = threads.collect(&:value)
+		assert_equal words.size, @vocab.size
+		threads.each_index { |t| assert_equal ids[0], ids[t].rotate(-t * 500) }
+		words.each_with_index { |word, i| assert_equal word, @vocab.word_for(ids[0][i]) }
+	end
+
+	def test_shared_between_classifiers
+		bayes = Classifier::Bayes.new 'Interesting', 'Uninteresting', :vocabulary => @vocab
+		lsi = Classifier::LSI.new :vocabulary => @vocab
+		bayes.train_interesting "here are some good words. I hope you love them"
+		lsi.add_item "here are some good words. I hope you love them"
+		assert_same @vocab, bayes.vocabulary
+		assert_same @vocab, lsi.vocabulary
+		assert_equal ['Interesting', 'Uninteresting'].sort, bayes.categories.sort
+	end
+
+	def test_classify_does_not_grow_vocabulary
+		bayes = Classifier::Bayes.new 'Interesting', 'Uninteresting', :vocabulary => @vocab
+		bayes.train_interesting "here are some good words. I hope you love them"
+		size = @vocab.size
+		bayes.classify "completely unseen vocabulary terms"
+		assert_equal size, @vocab.size
+	end
+
+	def test_compact
+		words = %w(apple applesauce apply banana band bandana b) + ["caf\u00e9", "x" * 300] + (1..500).collect { |i| "token#{i}" }
+		words.each { |word| @vocab.add word }
+		@vocab.compact!
+		assert @vocab.compact?
+		assert @vocab.frozen?
+		assert_equal words.size, @vocab.size
+		words.each_with_index do |word, id|
+			assert_equal id, @vocab[word]
+			assert_equal word, @vocab.word_for(id)
+		end
+		assert_nil @vocab["appl"]
+		assert_nil @vocab.add("unseen")
+		assert_equal words, @vocab.collect { |word, id| word }
+
+		loaded = Marshal.load(Marshal.dump(@vocab))
+		assert loaded.compact?
+		assert_equal 7, loaded["caf\u00e9"]
+	end
+
+	def test_compact_frozen
+		%w(hello world).each { |word| @vocab.add word }
+		@vocab.freeze
+		@vocab.compact!
+		assert @vocab.compact?
+		assert_equal 1, @vocab["world"]
+		@vocab = Classifier::Vocabulary.new(%w(hello world))
+		@vocab.freeze
+		loaded = Marshal.load(Marshal.dump(@vocab))
+		assert loaded.frozen?
+		loaded.compact!
+		assert_equal "world", loaded.word_for(1)
+		assert_nil loaded.add("unseen")
+	end
+
+	def test_compact_crc_collision
+		# Same length and same CRC32, so they share a bucket under every seed.
+		words = %w(cevhazkt wbliafui) + (1..50).collect { |i| "token#{i}" }
+		words.each { |word| @vocab.add word }
+		@vocab.compact!
+		words.each_with_index { |word, id| assert_equal id, @vocab[word] }
+
+		compact = Classifier::Vocabulary::Compact
+		seeds = compact::SEEDS
+		compact.send(:remove_const, :SEEDS)
+		compact.const_set(:SEEDS, 0)
+		overflowing = Classifier::Vocabulary.new(words).compact!
+		words.each_with_index { |word, id| assert_equal id, overflowing[word] }
+		assert_nil overflowing["unseen"]
+	ensure
+		compact.send(:remove_const, :SEEDS)
+		compact.const_set(:SEEDS, seeds)
+	end
+
+	def test_compact_classifier
+		bayes = Classifier::Bayes.new 'Interesting', 'Uninteresting', :vocabulary => @vocab
+		bayes.train_interesting "here are some good words. I hope you love them"
+		bayes.train_uninteresting "here are some bad words, I hate you"
+		scores = bayes.classifications "I hate bad words and you"
+		@vocab.compact!
+		assert_equal scores, bayes.classifications("I hate bad words and you")
+	end
+end